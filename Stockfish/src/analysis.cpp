@@ -0,0 +1,521 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "analysis.h"
+#include "engine.h"
+#include "movegen.h"
+#include "packed.h"
+#include "position.h"
+#include "uci.h"
+
+using namespace std;
+
+namespace {
+
+  // The EPD operations we write ourselves, dropped from the input
+  const vector<string> ResultOps = { "acd", "acn", "acs", "ce", "dm", "pm", "pv" };
+
+  // Job struct is one position of the batch, split into a FEN string for
+  // Position::set() and the EPD operations that follow it.
+  struct Job {
+    string fen, epd, ops;
+  };
+
+
+  // parse_epd() reads an EPD record. Plain FEN lines are accepted as well, in
+  // which case the move counters are taken from the FEN.
+
+  bool parse_epd(const string& line, Job& job) {
+
+    istringstream ss(line);
+    string board, side, castling, ep, rest, op, opcode;
+    int rule50 = 0, moveNumber = 1;
+
+    if (!(ss >> board >> side >> castling >> ep))
+        return false;
+
+    job.epd = board + " " + side + " " + castling + " " + ep;
+
+    getline(ss, rest);
+    istringstream counters(rest);
+    if (counters >> rule50 >> moveNumber)
+    {
+        rest.clear(); // Not cleared by getline() at the end of the line
+        getline(counters, rest);
+    }
+    else
+        rule50 = 0, moveNumber = 1;
+
+    job.fen = job.epd + " " + to_string(rule50) + " " + to_string(moveNumber);
+
+    istringstream ops(rest);
+    while (getline(ops, op, ';'))
+        if (istringstream(op) >> opcode && !count(ResultOps.begin(), ResultOps.end(), opcode))
+            job.ops += op.substr(op.find_first_not_of(' ')) + "; ";
+
+    return true;
+  }
+
+
+  // read_epd() reads the positions of an EPD file, skipping the blank lines and
+  // the comments, or of a packed file, skipping the records which are not valid
+  // positions. Returns false if the file cannot be opened.
+
+  bool read_epd(const string& fileName, vector<Job>& jobs) {
+
+    if (Packed::is_packed(fileName))
+    {
+        Packed::Reader reader(fileName);
+        StateInfo si;
+        Position pos;
+        char fen[MAX_FEN_LENGTH];
+
+        if (!reader.is_open())
+        {
+            sync_cout << "Unable to open file " << fileName << sync_endl;
+            return false;
+        }
+
+        jobs.reserve(reader.size());
+        size_t skipped = 0;
+
+        for (const Packed::Record& r : reader)
+        {
+            Job job;
+            if (pos.unpack(r.pos, &si, nullptr) && parse_epd(string(fen, pos.fen(fen)), job))
+                jobs.push_back(job);
+            else
+                ++skipped;
+        }
+
+        if (skipped)
+            cerr << "Skipped " << skipped << " records of " << fileName
+                 << ", not valid positions" << endl;
+
+        return true;
+    }
+
+    ifstream file(fileName);
+    string line;
+
+    if (!file.is_open())
+    {
+        sync_cout << "Unable to open file " << fileName << sync_endl;
+        return false;
+    }
+
+    while (getline(file, line))
+    {
+        Job job;
+        if (line.find_first_not_of(" \t\r") != string::npos && line[0] != '#' && parse_epd(line, job))
+            jobs.push_back(job);
+    }
+
+    return true;
+  }
+
+
+  // from_san() converts a move in Standard Algebraic Notation, as written in
+  // the 'bm' and 'am' operations of EPD, to the legal move it stands for. The
+  // check and annotation marks are ignored, and so are the '=' of promotions
+  // and the hyphens of castling, which may also be written with zeros. Moves in
+  // UCI coordinate notation are accepted as well.
+
+  Move from_san(const Position& pos, string san) {
+
+    san.erase(remove_if(san.begin(), san.end(),
+                        [](char c) { return c == '+' || c == '#' || c == '!' || c == '?'
+                                         || c == '=' || c == '-'; }), san.end());
+    replace(san.begin(), san.end(), '0', 'O');
+
+    for (Move m : MoveList<LEGAL>(pos))
+    {
+        Square from = from_sq(m), to = to_sq(m);
+        PieceType pt = type_of(pos.moved_piece(m));
+        string s;
+
+        if (type_of(m) == CASTLING)
+            s = to > from ? "OO" : "OOO";
+        else
+        {
+            if (pt != PAWN)
+            {
+                Bitboard others = 0;
+
+                for (Move m2 : MoveList<LEGAL>(pos))
+                    if (   m2 != m
+                        && to_sq(m2) == to
+                        && type_of(m2) != CASTLING
+                        && type_of(pos.moved_piece(m2)) == pt)
+                        others |= from_sq(m2);
+
+                s = " PNBRQK"[pt];
+
+                if (others)
+                    s +=  !(others & file_bb(from)) ? string(1, char('a' + file_of(from)))
+                        : !(others & rank_bb(from)) ? string(1, char('1' + rank_of(from)))
+                                                    : UCI::square(from);
+            }
+
+            if (pos.capture(m))
+                s += pt == PAWN ? string(1, char('a' + file_of(from))) + "x" : "x";
+
+            s += UCI::square(to);
+
+            if (type_of(m) == PROMOTION)
+                s += " PNBRQK"[promotion_type(m)];
+        }
+
+        if (s == san || UCI::move(m, pos.is_chess960()) == san)
+            return m;
+    }
+
+    return MOVE_NONE;
+  }
+
+
+  // Output class collects the results as the workers finish them, and prints
+  // them in input order, each one as soon as all the earlier ones are out.
+
+  class Output {
+  public:
+    explicit Output(size_t size) : results(size), done(size) {}
+
+    void put(size_t idx, const string& result) {
+
+      std::lock_guard<std::mutex> lk(mutex);
+      results[idx] = result;
+      done[idx] = true;
+
+      for ( ; next < done.size() && done[next]; ++next)
+      {
+          sync_cout << results[next] << sync_endl;
+          results[next].clear();
+      }
+    }
+
+  private:
+    std::mutex mutex;
+    vector<string> results;
+    vector<bool> done;
+    size_t next = 0;
+  };
+
+
+  // best_score() returns the score of the search just finished by 'engine' on
+  // 'pos', that of a mate or a stalemate if there is no legal move.
+
+  Value best_score(const Engine& engine, const Position& pos) {
+
+    const Search::RootMove& rm = engine.threads.main()->bestThread->rootMoves[0];
+    Value v = rm.score != -VALUE_INFINITE ? rm.score : rm.previousScore;
+
+    if (rm.pv[0] == MOVE_NONE)
+        v = pos.checkers() ? -VALUE_MATE : VALUE_DRAW;
+    else if (v == -VALUE_INFINITE)
+        v = VALUE_ZERO;
+
+    return v;
+  }
+
+
+  // format() returns the result of the search just finished by 'engine' on
+  // 'job', as an EPD record or a JSON line.
+
+  string format(const Engine& engine, const Position& pos, const Job& job,
+                size_t idx, TimePoint elapsed, bool json) {
+
+    const Thread* th = engine.threads.main()->bestThread;
+    const Search::RootMove& rm = th->rootMoves[0];
+    uint64_t nodes = engine.threads.nodes_searched();
+    Value v = best_score(engine, pos);
+
+    string scoreType, pv;
+    int score;
+    istringstream(UCI::value(v)) >> scoreType >> score; // "cp <x>" or "mate <y>"
+
+    stringstream ss;
+
+    if (json)
+    {
+        for (Move m : rm.pv)
+            if (m != MOVE_NONE)
+                pv += (pv.empty() ? "\"" : ", \"") + UCI::move(m, pos.is_chess960()) + "\"";
+
+        ss << "{\"index\": "   << idx
+           << ", \"fen\": \""  << job.fen
+           << "\", \"bestmove\": \"" << UCI::move(rm.pv[0], pos.is_chess960())
+           << "\", \"score\": {\"" << scoreType << "\": " << score
+           << "}, \"depth\": " << th->completedDepth
+           << ", \"seldepth\": " << rm.selDepth
+           << ", \"nodes\": "  << nodes
+           << ", \"time\": "   << elapsed
+           << ", \"pv\": ["    << pv << "]}";
+    }
+    else
+    {
+        for (Move m : rm.pv)
+            if (m != MOVE_NONE)
+                pv += (pv.empty() ? "" : " ") + UCI::move(m, pos.is_chess960());
+
+        ss << job.epd << " " << job.ops
+           << "acd " << th->completedDepth << "; "
+           << "acn " << nodes << "; "
+           << "acs " << elapsed / 1000 << "; "
+           << (scoreType == "cp" ? "ce " : "dm ") << score << "; ";
+
+        if (!pv.empty())
+            ss << "pm " << UCI::move(rm.pv[0], pos.is_chess960()) << "; pv " << pv << ";";
+    }
+
+    return ss.str();
+  }
+
+} // namespace
+
+
+/// Analysis::analyse_epd() searches every position of an EPD file with the given
+/// limits and prints the results in input order. The positions are handed out
+/// to the workers through a shared counter, and every worker clears its engine
+/// before each position, so that with private transposition tables the results
+/// do not depend on which worker got which position. With config.age the tables
+/// and histories are kept instead, the transposition table only aged, which is
+/// cheaper but no longer reproducible. A shared table is aged once for the
+/// whole batch. Moves are written in UCI coordinate notation, also
+/// in the EPD 'pm' and 'pv' operations. The positions may be read from a packed
+/// file, and the scores, best moves and depths found written to one as well,
+/// see Packed::Record.
+
+void Analysis::analyse_epd(Engine& engine, const string& fileName,
+                           const Search::LimitsType& limits, const Config& config) {
+
+  vector<Job> jobs;
+
+  if (!read_epd(fileName, jobs))
+      return;
+
+  engine.threads.main()->wait_for_search_finished();
+
+  Eval::NNUE::NetPtr net = engine.net ? engine.net : Eval::NNUE::active_net();
+  Eval::NNUE::verify(net);
+
+  // The memory given by the options is split among the workers
+  size_t ttSize = size_t(Options["Hash"]), evalCacheSize = size_t(Options["Eval Cache"]);
+  size_t workerTTSize = config.sharedTT ? ttSize : std::max(ttSize / config.workers, size_t(1));
+  size_t workerEvalCacheSize = evalCacheSize ? std::max(evalCacheSize / config.workers, size_t(1)) : 0;
+  TranspositionTable sharedTT;
+  if (config.sharedTT)
+  {
+      sharedTT.resize(ttSize, config.workers * config.threads);
+      sharedTT.new_search(); // Once for the batch, the workers do not age it
+  }
+
+  Output output(jobs.size());
+  vector<Packed::Record> records(config.packedFile.empty() ? 0 : jobs.size());
+  std::atomic<size_t> nextJob(0);
+  std::atomic<uint64_t> totalNodes(0);
+  vector<std::thread> workers;
+  TimePoint elapsed = now();
+
+  for (size_t w = 0; w < config.workers; ++w)
+      workers.emplace_back([&]() {
+
+          Engine worker(config.threads, workerTTSize, workerEvalCacheSize,
+                        config.sharedTT ? &sharedTT : nullptr);
+          worker.net = engine.net; // The network pinned by our caller, if any
+          StateListPtr states;
+          Position pos;
+
+          for (size_t idx; (idx = nextJob++) < jobs.size(); )
+          {
+              if (!config.age)
+                  worker.clear();
+
+              states = StateListPtr(new std::deque<StateInfo>(1));
+              pos.set(jobs[idx].fen, Options["UCI_Chess960"], &states->back(), worker.threads.main());
+
+              Search::LimitsType lim = limits;
+              lim.startTime = now();
+              lim.silent = true;
+
+              worker.threads.start_thinking(pos, states, lim);
+              worker.threads.main()->wait_for_search_finished();
+
+              totalNodes += worker.threads.nodes_searched();
+              output.put(idx, format(worker, pos, jobs[idx], idx, now() - lim.startTime, config.json));
+
+              if (!records.empty())
+              {
+                  const Thread* th = worker.threads.main()->bestThread;
+
+                  records[idx] = Packed::record(pos);
+                  records[idx].score = int16_t(best_score(worker, pos));
+                  records[idx].move = uint16_t(th->rootMoves[0].pv[0]);
+                  records[idx].depth = uint8_t(std::max(th->completedDepth, 0));
+              }
+          }
+      });
+
+  for (std::thread& th : workers)
+      th.join();
+
+  if (!records.empty())
+  {
+      Packed::Writer writer(config.packedFile);
+
+      if (!writer.is_open())
+          sync_cout << "Unable to open file " << config.packedFile << sync_endl;
+
+      for (const Packed::Record& r : records)
+          writer.write(r);
+  }
+
+  elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+  cerr << "\n==========================="
+       << "\nPositions       : " << jobs.size()
+       << "\nWorkers         : " << config.workers << " x " << config.threads << " threads"
+       << "\nTotal time (ms) : " << elapsed
+       << "\nNodes searched  : " << totalNodes
+       << "\nNodes/second    : " << 1000 * totalNodes / elapsed << endl;
+}
+
+
+/// Analysis::solve() searches the positions of an EPD test suite one at a time
+/// with the given limits, and checks the move played against their 'bm' (best
+/// moves) or 'am' (moves to avoid) operations. A position is solved when the
+/// move played is right, at the first iteration of the thread which played it
+/// from which its best move stayed right up to the end of the search. The solve
+/// rate and the geometric means of the time and of the nodes to solution, over
+/// the solved positions, are printed at the end.
+
+void Analysis::solve(Engine& engine, const string& fileName, const Search::LimitsType& limits) {
+
+  vector<Job> jobs;
+
+  if (!read_epd(fileName, jobs))
+      return;
+
+  engine.threads.main()->wait_for_search_finished();
+
+  StateListPtr states;
+  Position pos;
+  size_t tested = 0, solved = 0;
+  double logTime = 0, logNodes = 0;
+
+  for (size_t idx = 0; idx < jobs.size(); ++idx)
+  {
+      states = StateListPtr(new std::deque<StateInfo>(1));
+      pos.set(jobs[idx].fen, Options["UCI_Chess960"], &states->back(), engine.threads.main());
+
+      vector<Move> best, avoid;
+      string op, opcode, token, id = to_string(idx + 1);
+      istringstream ops(jobs[idx].ops);
+
+      while (getline(ops, op, ';'))
+      {
+          istringstream ss(op);
+          ss >> opcode;
+
+          if (opcode == "id" && getline(ss >> ws, id))
+              id.erase(remove(id.begin(), id.end(), '"'), id.end());
+
+          else if (opcode == "bm" || opcode == "am")
+              while (ss >> token)
+              {
+                  Move m = from_san(pos, token);
+
+                  if (m == MOVE_NONE)
+                      cerr << "Position " << idx + 1 << ": illegal move " << token << endl;
+                  else
+                      (opcode == "bm" ? best : avoid).push_back(m);
+              }
+      }
+
+      if (best.empty() && avoid.empty())
+      {
+          cerr << id << ": no 'bm' or 'am' move, skipped" << endl;
+          continue;
+      }
+
+      engine.clear();
+
+      Search::LimitsType lim = limits;
+      lim.startTime = now();
+      lim.silent = true;
+
+      engine.threads.start_thinking(pos, states, lim);
+      engine.threads.main()->wait_for_search_finished();
+
+      auto right = [&](Move m) {
+          return   (best.empty() || count(best.begin(), best.end(), m))
+                && !count(avoid.begin(), avoid.end(), m);
+      };
+
+      // The move played and the iterations are those of the same thread
+      const Thread* th = engine.threads.main()->bestThread;
+      Move played = th->rootMoves[0].pv[0];
+
+      // Unless an iteration found it, the move was found at the very end
+      Iteration solution = { th->completedDepth, played,
+                             now_us() - engine.threads.goTime, engine.threads.nodes_searched() };
+
+      ++tested;
+
+      if (!right(played))
+      {
+          cerr << id << ": not solved, played " << UCI::move(played, pos.is_chess960()) << endl;
+          continue;
+      }
+
+      for (auto it = th->iterations.rbegin(); it != th->iterations.rend() && right(it->bestMove); ++it)
+          solution = *it;
+
+      ++solved;
+      logTime += std::log(std::max(solution.timeUs, int64_t(1)) / 1000.0);
+      logNodes += std::log(std::max(solution.nodes, uint64_t(1)));
+
+      cerr << id << ": solved with " << UCI::move(played, pos.is_chess960())
+           << " at depth " << solution.depth
+           << " in " << solution.timeUs / 1000.0 << " ms and " << solution.nodes << " nodes" << endl;
+  }
+
+  cerr << "\n==========================="
+       << "\nPositions       : " << tested
+       << "\nSolved          : " << solved << " (" << std::fixed << std::setprecision(1)
+                                << 100.0 * solved / std::max(tested, size_t(1)) << "%)";
+
+  if (solved)
+      cerr << "\nSolution time   : " << std::setprecision(2) << std::exp(logTime / solved)
+           << " ms (geometric mean)"
+           << "\nSolution nodes  : " << std::setprecision(0) << std::exp(logNodes / solved)
+           << " (geometric mean)";
+
+  cerr << std::defaultfloat << endl;
+}
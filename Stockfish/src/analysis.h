@@ -0,0 +1,51 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ANALYSIS_H_INCLUDED
+#define ANALYSIS_H_INCLUDED
+
+#include <string>
+
+#include "search.h"
+
+class Engine;
+
+namespace Analysis {
+
+/// Config struct tells how a batch of positions is spread over the cores. Each
+/// worker is an Engine of its own that searches one position at a time, so the
+/// batch scales with the number of workers instead of with Lazy SMP. The Hash
+/// and Eval Cache sizes are those of the whole batch, split among the workers
+/// unless the transposition table is shared.
+
+struct Config {
+  size_t workers = 1;     // Positions searched at the same time
+  size_t threads = 1;     // Search threads of each worker
+  bool sharedTT = false;  // One transposition table for all the workers
+  bool age = false;       // Age the tables between positions instead of clearing them
+  bool json = false;      // Output JSON lines instead of EPD
+  std::string packedFile; // Also write the results to this packed file, if any
+};
+
+void analyse_epd(Engine& engine, const std::string& fileName,
+                 const Search::LimitsType& limits, const Config& config);
+void solve(Engine& engine, const std::string& fileName, const Search::LimitsType& limits);
+
+} // namespace Analysis
+
+#endif // #ifndef ANALYSIS_H_INCLUDED
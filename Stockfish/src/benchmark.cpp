@@ -16,11 +16,17 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <istream>
+#include <sstream>
 #include <vector>
 
+#include "benchmark.h"
 #include "position.h"
 
 using namespace std;
@@ -90,6 +96,40 @@ const vector<string> Defaults = {
   "setoption name UCI_Chess960 value false"
 };
 
+// Two-sided 95% quantiles of the Student t distribution, by degrees of freedom
+constexpr double TQuantiles[] = {
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+   2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+   2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+// t_quantile() rounds the degrees of freedom down, which errs on the safe side,
+// and uses the normal distribution beyond the table.
+
+double t_quantile(double df) {
+
+  int i = int(df);
+  return i < 1 ? TQuantiles[0] : i <= 30 ? TQuantiles[i - 1] : 1.960;
+}
+
+void print_stats(ostream& os, const Bench::Stats& s) {
+
+  os << "{\"mean\": " << s.mean << ", \"stddev\": " << s.stddev
+     << ", \"ci95\": [" << s.ciLow << ", " << s.ciHigh << "]}";
+}
+
+// metric_stats() summarizes one field of the samples of a bench position
+
+template<typename T>
+Bench::Stats metric_stats(const vector<Bench::Sample>& samples, T f) {
+
+  vector<double> values;
+  for (const auto& s : samples)
+      values.push_back(f(s));
+
+  return Bench::stats(values);
+}
+
 } // namespace
 
 /// setup_bench() builds a list of UCI commands to be run by bench. There
@@ -168,3 +208,162 @@ vector<string> setup_bench(const Position& current, istream& is) {
 
   return list;
 }
+
+
+namespace Bench {
+
+/// default_positions() returns the positions searched by default by bench,
+/// mixed with the "setoption" commands that go with them.
+
+const vector<string>& default_positions() {
+  return Defaults;
+}
+
+
+/// stats() returns the mean and the sample standard deviation of a series of
+/// measures. A single measure has no spread and an empty confidence interval.
+
+Stats stats(const vector<double>& samples) {
+
+  Stats s;
+  size_t n = samples.size();
+
+  if (!n)
+      return s;
+
+  for (double x : samples)
+      s.mean += x / n;
+
+  for (double x : samples)
+      s.stddev += (x - s.mean) * (x - s.mean);
+
+  s.stddev = n > 1 ? std::sqrt(s.stddev / (n - 1)) : 0;
+
+  double margin = n > 1 ? t_quantile(n - 1) * s.stddev / std::sqrt(double(n)) : 0;
+  s.ciLow  = s.mean - margin;
+  s.ciHigh = s.mean + margin;
+
+  return s;
+}
+
+
+/// read_baseline() reads the nodes per second of the runs from a report saved
+/// by an earlier "benchreport", i.e. the "run_nps" array of its JSON.
+
+bool read_baseline(const string& fileName, vector<double>& runNps) {
+
+  ifstream file(fileName);
+  stringstream ss;
+
+  if (!file.is_open())
+      return false;
+
+  ss << file.rdbuf();
+  string json = ss.str();
+  size_t start = json.find('[', json.find("\"run_nps\""));
+  size_t end = json.find(']', start);
+
+  if (start == string::npos || end == string::npos)
+      return false;
+
+  istringstream list(json.substr(start + 1, end - start - 1));
+  runNps.clear();
+
+  for (string token; getline(list, token, ','); )
+      runNps.push_back(std::strtod(token.c_str(), nullptr));
+
+  return !runNps.empty();
+}
+
+
+/// compare() tests whether the current runs are slower than the baseline ones,
+/// with Welch's t-test, which does not assume equal variances. With a single
+/// run on either side there is no variance to test, only the threshold applies.
+
+Comparison compare(const vector<double>& baseline, const vector<double>& current, double threshold) {
+
+  Comparison c;
+  Stats now = stats(current);
+  double nb = double(baseline.size()), nc = double(current.size());
+
+  c.baseline = stats(baseline);
+  c.change = 100 * (now.mean - c.baseline.mean) / std::max(c.baseline.mean, 1.0);
+  c.t = 0;
+
+  double vb = c.baseline.stddev * c.baseline.stddev / nb;
+  double vc = now.stddev * now.stddev / nc;
+
+  if (nb < 2 || nc < 2 || vb + vc == 0)
+  {
+      c.slowdown = c.change < -threshold;
+      return c;
+  }
+
+  double df = (vb + vc) * (vb + vc) / (vb * vb / (nb - 1) + vc * vc / (nc - 1));
+
+  c.t = (c.baseline.mean - now.mean) / std::sqrt(vb + vc);
+  c.slowdown = c.change < -threshold && c.t > t_quantile(df);
+
+  return c;
+}
+
+
+/// to_json() formats a report as a JSON object: the statistics of each position
+/// over the runs, those of the whole runs and the comparison with a baseline.
+
+string to_json(const Report& report, const Comparison* comparison, const string& baselineFile) {
+
+  stringstream ss;
+  uint64_t nodes = 0;
+
+  ss << std::fixed << std::setprecision(2)
+     << "{\n  \"settings\": \"" << report.settings << "\","
+     << "\n  \"runs\": " << report.runNps.size() << ","
+     << "\n  \"positions\": [";
+
+  for (size_t i = 0; i < report.records.size(); ++i)
+  {
+      const Record& r = report.records[i];
+
+      for (const auto& s : r.samples)
+          nodes += s.nodes;
+
+      ss << (i ? "," : "") << "\n    {\"fen\": \"" << r.fen << "\", \"eval\": \"" << r.evalType << "\""
+         << ",\n     \"depth\": ";
+      print_stats(ss, metric_stats(r.samples, [](const Sample& s) { return double(s.depth); }));
+      ss << ",\n     \"nodes\": ";
+      print_stats(ss, metric_stats(r.samples, [](const Sample& s) { return double(s.nodes); }));
+      ss << ",\n     \"time_ms\": ";
+      print_stats(ss, metric_stats(r.samples, [](const Sample& s) { return s.timeUs / 1000.0; }));
+      ss << ",\n     \"nps\": ";
+      print_stats(ss, metric_stats(r.samples, [](const Sample& s) { return 1e6 * s.nodes / std::max(s.timeUs, int64_t(1)); }));
+      ss << ",\n     \"hashfull\": ";
+      print_stats(ss, metric_stats(r.samples, [](const Sample& s) { return double(s.hashfull); }));
+      ss << "}";
+  }
+
+  ss << "\n  ],\n  \"total\": {\"nodes\": " << nodes / std::max(report.runNps.size(), size_t(1))
+     << ", \"nps\": ";
+  print_stats(ss, stats(report.runNps));
+  ss << "},\n  \"run_nps\": [";
+
+  for (size_t i = 0; i < report.runNps.size(); ++i)
+      ss << (i ? ", " : "") << report.runNps[i];
+
+  ss << "]";
+
+  if (comparison)
+  {
+      ss << ",\n  \"baseline\": {\"file\": \"" << baselineFile << "\", \"nps\": ";
+      print_stats(ss, comparison->baseline);
+      ss << ", \"change_percent\": " << comparison->change
+         << ", \"t\": " << comparison->t
+         << ", \"significant_slowdown\": " << (comparison->slowdown ? "true" : "false") << "}";
+  }
+
+  ss << "\n}";
+
+  return ss.str();
+}
+
+} // namespace Bench
@@ -0,0 +1,86 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENCHMARK_H_INCLUDED
+#define BENCHMARK_H_INCLUDED
+
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+class Position;
+
+std::vector<std::string> setup_bench(const Position& current, std::istream& is);
+
+namespace Bench {
+
+/// Sample is the result of one search of the bench, in one of the runs
+
+struct Sample {
+  uint64_t nodes;
+  int64_t timeUs;
+  Depth depth;
+  int hashfull;
+};
+
+/// Record holds the samples of one bench position, one per run
+
+struct Record {
+  std::string fen;
+  std::string evalType;
+  std::vector<Sample> samples;
+};
+
+/// Stats summarizes a series of measures, with a 95% confidence interval of
+/// their mean from the Student t distribution.
+
+struct Stats {
+  double mean = 0, stddev = 0, ciLow = 0, ciHigh = 0;
+};
+
+/// Comparison is the outcome of Welch's t-test between the nodes per second of
+/// the runs of a baseline and of the current binary. A slowdown is significant
+/// when it is larger than the threshold and the test rejects equal means.
+
+struct Comparison {
+  Stats baseline;
+  double change;    // In percent, negative for a slowdown
+  double t;         // Positive when the baseline is faster
+  bool slowdown;
+};
+
+/// Report gathers the runs of a bench, as built by the "benchreport" command
+
+struct Report {
+  std::string settings;        // The bench parameters
+  std::vector<Record> records;
+  std::vector<double> runNps;  // Nodes per second of each whole run
+};
+
+const std::vector<std::string>& default_positions();
+void microbench(int sampleMs, int samples);
+Stats stats(const std::vector<double>& samples);
+bool read_baseline(const std::string& fileName, std::vector<double>& runNps);
+Comparison compare(const std::vector<double>& baseline, const std::vector<double>& current, double threshold);
+std::string to_json(const Report& report, const Comparison* comparison, const std::string& baselineFile);
+
+} // namespace Bench
+
+#endif // #ifndef BENCHMARK_H_INCLUDED
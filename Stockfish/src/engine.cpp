@@ -0,0 +1,97 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "engine.h"
+
+
+/// Engine constructor starts the search threads and allocates the hash tables,
+/// unless a shared transposition table is given.
+
+Engine::Engine(size_t threadCount, size_t ttSizeMB, size_t evalCacheSizeMB,
+               TranspositionTable* sharedTT)
+  : threads(*this), tt(sharedTT ? *sharedTT : ownTT), time(threads), telemetry(*this),
+    ttSize(ttSizeMB), evalCacheSize(evalCacheSizeMB) {
+
+  set_threads(threadCount);
+  clear();
+}
+
+
+/// Engine destructor waits for the search, if any, and joins the threads
+
+Engine::~Engine() {
+
+  threads.main()->wait_for_search_finished();
+  telemetry.join(); // Its last line reads the threads
+  threads.set(0);
+}
+
+
+/// Engine::set_threads() recreates the pool of search threads. The hash tables
+/// are reallocated as well, so that their memory is first touched by threads
+/// bound like the new ones.
+
+void Engine::set_threads(size_t threadCount) {
+
+  telemetry.join(); // Idem
+  threads.set(threadCount);
+  if (&tt == &ownTT)
+      tt.resize(ttSize, threads.size());
+  evalCache.resize(evalCacheSize);
+}
+
+
+/// Engine::resize_tt() sets the size of the transposition table in megabytes
+
+void Engine::resize_tt(size_t mbSize) {
+
+  threads.main()->wait_for_search_finished();
+
+  if (&tt != &ownTT)
+      return;
+
+  ttSize = mbSize;
+  tt.resize(ttSize, threads.size());
+}
+
+
+/// Engine::resize_eval_cache() sets the size of the eval cache in megabytes,
+/// zero turns it off.
+
+void Engine::resize_eval_cache(size_t mbSize) {
+
+  threads.main()->wait_for_search_finished();
+
+  evalCacheSize = mbSize;
+  evalCache.resize(evalCacheSize);
+}
+
+
+/// Engine::clear() resets the search state to its initial value, e.g. before
+/// a new game.
+
+void Engine::clear() {
+
+  threads.main()->wait_for_search_finished();
+
+  time.availableNodes = 0;
+  if (&tt == &ownTT)
+      tt.clear(threads.size());
+  evalCache.clear();
+  threads.clear();
+}
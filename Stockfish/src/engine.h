@@ -0,0 +1,66 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ENGINE_H_INCLUDED
+#define ENGINE_H_INCLUDED
+
+#include "evalcache.h"
+#include "evaluate.h"
+#include "search.h"
+#include "telemetry.h"
+#include "thread.h"
+#include "timeman.h"
+#include "tt.h"
+
+/// Engine owns everything a search works on: the pool of search threads, the
+/// transposition table, the eval cache, the search limits and the time manager.
+/// Engines are independent of each other, so that several of them can search
+/// at the same time in one process. They only share the read-only tables set
+/// up at startup (bitboards, PSQT, endgames, tablebases), the resident NNUE
+/// networks and the UCI options. The UCI loops are clients of one Engine.
+/// An engine may also be given the transposition table of another one, which
+/// it then uses but never resizes, clears nor ages: the owner of the table
+/// starts its new generations.
+
+class Engine {
+public:
+  Engine(size_t threadCount, size_t ttSizeMB, size_t evalCacheSizeMB,
+         TranspositionTable* sharedTT = nullptr);
+ ~Engine();
+
+  void set_threads(size_t threadCount);
+  void resize_tt(size_t mbSize);
+  void resize_eval_cache(size_t mbSize);
+  void clear();
+  bool owns_tt() const { return &tt == &ownTT; }
+  size_t tt_size() const { return ttSize; } // In megabytes
+
+  ThreadPool threads;
+  TranspositionTable& tt; // Our own table or a shared one
+  EvalCache evalCache;
+  Search::LimitsType limits;
+  TimeManagement time;
+  Eval::NNUE::NetPtr net; // Network used by the searches, the active one if null
+  Telemetry telemetry;
+
+private:
+  TranspositionTable ownTT;
+  size_t ttSize, evalCacheSize;
+};
+
+#endif // #ifndef ENGINE_H_INCLUDED
@@ -0,0 +1,141 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cstring>   // For std::memset
+#include <iostream>
+
+#include "engine.h"
+#include "evalcache.h"
+#include "evaluate.h"
+#include "position.h"
+#include "thread.h"
+
+namespace {
+
+  // The static evaluation depends on the rule 50 counter, which is not part
+  // of the position key, so mix it in to avoid reusing shuffled-down values.
+  // Likewise the salt keeps apart evaluations made with different networks.
+  Key cache_key(const Position& pos) {
+    return  pos.key() ^ pos.this_thread()->evalSalt
+          ^ (Key(pos.rule50_count()) * 0x9E3779B97F4A7C15ULL);
+  }
+
+} // namespace
+
+
+/// EvalCache::resize() sets the size of the eval cache, measured in megabytes.
+/// A size of zero frees the table and turns the cache off. The search threads
+/// using the cache must be idle.
+
+void EvalCache::resize(size_t mbSize) {
+
+  aligned_large_pages_free(table);
+  table = nullptr;
+
+  entryCount = mbSize * 1024 * 1024 / sizeof(Entry);
+
+  if (!entryCount)
+      return;
+
+  table = static_cast<Entry*>(aligned_large_pages_alloc(entryCount * sizeof(Entry)));
+  if (!table)
+  {
+      std::cerr << "Failed to allocate " << mbSize
+                << "MB for eval cache." << std::endl;
+      exit(EXIT_FAILURE);
+  }
+
+  clear();
+}
+
+
+/// EvalCache::clear() zeroes the whole table. A zero entry can only match a
+/// zero key, which is practically impossible.
+
+void EvalCache::clear() {
+
+  if (table)
+      std::memset(static_cast<void*>(table), 0, entryCount * sizeof(Entry));
+}
+
+
+/// EvalCache::probe() looks up a key and, on success, stores the cached
+/// evaluation in v and returns true.
+
+bool EvalCache::probe(Key key, Value& v) const {
+
+  if (!table)
+      return false;
+
+  const Entry& e = table[mul_hi64(key, entryCount)];
+  uint64_t data = e.data.load(std::memory_order_relaxed);
+
+  if ((e.keyXorData.load(std::memory_order_relaxed) ^ data) != key)
+      return false;
+
+  v = Value(int16_t(data));
+  return true;
+}
+
+
+/// EvalCache::save() stores an evaluation, overwriting whatever was there
+
+void EvalCache::save(Key key, Value v) {
+
+  if (!table)
+      return;
+
+  Entry& e = table[mul_hi64(key, entryCount)];
+  uint64_t data = uint16_t(v);
+
+  e.keyXorData.store(key ^ data, std::memory_order_relaxed);
+  e.data.store(data, std::memory_order_relaxed);
+}
+
+
+/// EvalCache::evaluate() is a drop-in replacement for Eval::evaluate() that
+/// consults the cache first. Hits and probes are counted on the thread owning
+/// the position, so it can be used by search and offline scoring alike. Only
+/// that thread writes them, so they are updated without a locked increment.
+
+Value EvalCache::evaluate(const Position& pos) {
+
+  Thread* th = pos.this_thread();
+  Key key = cache_key(pos);
+  Value v;
+
+  // The evaluation includes the contempt of the thread, so in deterministic
+  // mode the threads must not see the evaluations of each other.
+  if (th->engine.threads.deterministic)
+      return Eval::evaluate(pos);
+
+  th->evalCacheProbes.store(th->evalCacheProbes.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_relaxed);
+
+  if (probe(key, v))
+  {
+      th->evalCacheHits.store(th->evalCacheHits.load(std::memory_order_relaxed) + 1,
+                              std::memory_order_relaxed);
+      return v;
+  }
+
+  v = Eval::evaluate(pos);
+  save(key, v);
+  return v;
+}
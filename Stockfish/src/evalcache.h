@@ -0,0 +1,59 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EVALCACHE_H_INCLUDED
+#define EVALCACHE_H_INCLUDED
+
+#include <atomic>
+
+#include "misc.h"
+#include "types.h"
+
+class Position;
+
+/// EvalCache is a small direct-mapped table of static evaluations shared by
+/// all the search threads. It is lock-free: each Entry stores the key XOR-ed
+/// with the data next to the data itself, so a torn write by a concurrent
+/// thread makes the key check fail and is seen as a miss. Entries are always
+/// replaced, the table is cleared together with the transposition table and
+/// a size of zero disables it.
+
+class EvalCache {
+
+  struct Entry {
+    std::atomic<uint64_t> keyXorData;
+    std::atomic<uint64_t> data;
+  };
+
+  static_assert(sizeof(Entry) == 16, "Unexpected Entry size");
+
+public:
+ ~EvalCache() { aligned_large_pages_free(table); }
+  bool probe(Key key, Value& v) const;
+  void save(Key key, Value v);
+  void resize(size_t mbSize);
+  void clear();
+
+  Value evaluate(const Position& pos);
+
+private:
+  size_t entryCount = 0;
+  Entry* table = nullptr;
+};
+
+#endif // #ifndef EVALCACHE_H_INCLUDED
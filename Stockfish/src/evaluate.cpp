@@ -21,6 +21,7 @@
 #include <cstdlib>
 #include <cstring>   // For std::memset
 #include <fstream>
+#include <future>
 #include <iomanip>
 #include <sstream>
 #include <iostream>
@@ -32,9 +33,11 @@
 #include "material.h"
 #include "misc.h"
 #include "pawns.h"
+#include "profiler.h"
 #include "thread.h"
 #include "uci.h"
 #include "incbin/incbin.h"
+#include "nnue/evaluate_nnue.h"
 
 
 // Macro to embed the default efficiently updatable neural network (NNUE) file
@@ -59,15 +62,64 @@ using namespace Eval::NNUE;
 namespace Eval {
 
   bool useNNUE;
-  string eval_file_loaded = "None";
 
-  /// NNUE::init() tries to load a NNUE network at startup time, or when the engine
-  /// receives a UCI command "setoption name EvalFile value nn-[a-z0-9]{12}.nnue"
-  /// The name of the NNUE network is always retrieved from the EvalFile option.
-  /// We search the given network in three locations: internally (the default
-  /// network may be embedded in the binary), in the active working directory and
-  /// in the engine directory. Distro packagers may define the DEFAULT_NNUE_DIRECTORY
-  /// variable to have the engine search in a special directory in their distro.
+  namespace {
+
+    // Background loading of a network, see NNUE::load_async()
+    future<void> loader;
+
+    // load_file() looks for a network file in three locations: internally (the
+    // default network may be embedded in the binary), in the active working
+    // directory and in the engine directory. Distro packagers may define the
+    // DEFAULT_NNUE_DIRECTORY variable to have the engine search in a special
+    // directory in their distro. A network already resident in memory is just
+    // made active again.
+
+    bool load_file(const string& eval_file) {
+
+      if (NNUE::select_net(eval_file))
+          return true;
+
+      #if defined(DEFAULT_NNUE_DIRECTORY)
+      #define stringify2(x) #x
+      #define stringify(x) stringify2(x)
+      vector<string> dirs = { "<internal>" , "" , CommandLine::binaryDirectory , stringify(DEFAULT_NNUE_DIRECTORY) };
+      #else
+      vector<string> dirs = { "<internal>" , "" , CommandLine::binaryDirectory };
+      #endif
+
+      for (string directory : dirs)
+      {
+          if (directory != "<internal>")
+          {
+              ifstream stream(directory + eval_file, ios::binary);
+              if (load_eval(eval_file, stream))
+                  return true;
+          }
+
+          if (directory == "<internal>" && eval_file == EvalFileDefaultName)
+          {
+              // C++ way to prepare a buffer for a memory stream
+              class MemoryBuffer : public basic_streambuf<char> {
+                  public: MemoryBuffer(char* p, size_t n) { setg(p, p, p + n); setp(p, p + n); }
+              };
+
+              MemoryBuffer buffer(const_cast<char*>(reinterpret_cast<const char*>(gEmbeddedNNUEData)),
+                                  size_t(gEmbeddedNNUESize));
+
+              istream stream(&buffer);
+              if (load_eval(eval_file, stream))
+                  return true;
+          }
+      }
+
+      return false;
+    }
+
+  } // namespace
+
+  /// NNUE::init() loads the NNUE network named by the EvalFile option at startup
+  /// time or when NNUE is switched on, and waits for it.
 
   void NNUE::init() {
 
@@ -75,49 +127,42 @@ namespace Eval {
     if (!useNNUE)
         return;
 
-    string eval_file = string(Options["EvalFile"]);
+    if (loader.valid())
+        loader.wait();
 
-    #if defined(DEFAULT_NNUE_DIRECTORY)
-    #define stringify2(x) #x
-    #define stringify(x) stringify2(x)
-    vector<string> dirs = { "<internal>" , "" , CommandLine::binaryDirectory , stringify(DEFAULT_NNUE_DIRECTORY) };
-    #else
-    vector<string> dirs = { "<internal>" , "" , CommandLine::binaryDirectory };
-    #endif
+    load_file(string(Options["EvalFile"]));
+  }
 
-    for (string directory : dirs)
-        if (eval_file_loaded != eval_file)
-        {
-            if (directory != "<internal>")
-            {
-                ifstream stream(directory + eval_file, ios::binary);
-                if (load_eval(eval_file, stream))
-                    eval_file_loaded = eval_file;
-            }
+  /// NNUE::load_async() loads a network on a background thread, when the engine
+  /// receives "setoption name EvalFile value nn-[a-z0-9]{12}.nnue" or "net load".
+  /// Searches keep running with their network, and the new one is swapped in
+  /// for the following searches once it has been read successfully.
 
-            if (directory == "<internal>" && eval_file == EvalFileDefaultName)
-            {
-                // C++ way to prepare a buffer for a memory stream
-                class MemoryBuffer : public basic_streambuf<char> {
-                    public: MemoryBuffer(char* p, size_t n) { setg(p, p, p + n); setp(p, p + n); }
-                };
+  void NNUE::load_async(const string& evalFile) {
 
-                MemoryBuffer buffer(const_cast<char*>(reinterpret_cast<const char*>(gEmbeddedNNUEData)),
-                                    size_t(gEmbeddedNNUESize));
+    if (loader.valid())
+        loader.wait();
 
-                istream stream(&buffer);
-                if (load_eval(eval_file, stream))
-                    eval_file_loaded = eval_file;
-            }
-        }
+    loader = async(launch::async, [evalFile]() {
+
+        NetPtr previous = active_net();
+
+        if (load_file(evalFile))
+            sync_cout << "info string NNUE network " << evalFile << " loaded" << sync_endl;
+        else
+            sync_cout << "info string ERROR: the network file " << evalFile
+                      << " was not loaded successfully, still using "
+                      << (previous ? previous->name : "none") << sync_endl;
+    });
   }
 
-  /// NNUE::verify() verifies that the last net used was loaded successfully
-  void NNUE::verify() {
+  /// NNUE::verify() verifies that a network is available for the search
+
+  void NNUE::verify(const NetPtr& net) {
 
     string eval_file = string(Options["EvalFile"]);
 
-    if (useNNUE && eval_file_loaded != eval_file)
+    if (useNNUE && !net)
     {
         UCI::OptionsMap defaults;
         UCI::init(defaults);
@@ -138,7 +183,7 @@ namespace Eval {
     }
 
     if (useNNUE)
-        sync_cout << "info string NNUE evaluation using " << eval_file << " enabled" << sync_endl;
+        sync_cout << "info string NNUE evaluation using " << net->name << " enabled" << sync_endl;
     else
         sync_cout << "info string classical evaluation enabled" << sync_endl;
   }
@@ -964,6 +1009,8 @@ namespace {
   template<Tracing T>
   Value Evaluation<T>::value() {
 
+    Profiler::Scope<Profiler::EVAL_CLASSICAL> scope;
+
     assert(!pos.checkers());
 
     // Probe the material hash table
@@ -1041,9 +1088,14 @@ make_v:
 
 /// evaluate() is the evaluator for the outer world. It returns a static
 /// evaluation of the position from the point of view of the side to move.
+/// The evaluations are counted on the thread owning the position.
 
 Value Eval::evaluate(const Position& pos) {
 
+  Thread* th = pos.this_thread();
+  th->evaluations.store(th->evaluations.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+
   Value v;
 
   if (!Eval::useNNUE)
@@ -1088,6 +1140,16 @@ Value Eval::evaluate(const Position& pos) {
   return v;
 }
 
+
+/// evaluate_classical() returns the classical evaluation alone, without the
+/// adjustments of evaluate(). It is used to time the evaluation on its own.
+
+Value Eval::evaluate_classical(const Position& pos) {
+
+  return Evaluation<NO_TRACE>(pos).value();
+}
+
+
 /// trace() is like evaluate(), but instead of returning a value, it returns
 /// a string (suitable for outputting to stdout) that contains the detailed
 /// descriptions and values of each evaluation term. Useful for debugging.
@@ -19,7 +19,9 @@
 #ifndef EVALUATE_H_INCLUDED
 #define EVALUATE_H_INCLUDED
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "types.h"
 
@@ -29,9 +31,9 @@ namespace Eval {
 
   std::string trace(const Position& pos);
   Value evaluate(const Position& pos);
+  Value evaluate_classical(const Position& pos);
 
   extern bool useNNUE;
-  extern std::string eval_file_loaded;
 
   // The default net name MUST follow the format nn-[SHA256 first 12 digits].nnue
   // for the build process (profile-build and fishtest) to work. Do not change the
@@ -40,10 +42,19 @@ namespace Eval {
 
   namespace NNUE {
 
+    struct Net;
+    using NetPtr = std::shared_ptr<const Net>;
+
     Value evaluate(const Position& pos);
     bool load_eval(std::string name, std::istream& stream);
+    NetPtr active_net();
+    NetPtr find_net(const std::string& name);
+    bool select_net(const std::string& name);
+    bool unload_net(const std::string& name);
+    std::vector<std::string> resident_nets();
+    void load_async(const std::string& evalFile);
     void init();
-    void verify();
+    void verify(const NetPtr& net);
 
   } // namespace NNUE
 
@@ -19,6 +19,7 @@
 #include <iostream>
 
 #include "bitboard.h"
+#include "engine.h"
 #include "endgame.h"
 #include "position.h"
 #include "psqt.h"
@@ -30,6 +31,7 @@
 
 int main(int argc, char* argv[]) {
 
+  start_output();
   std::cout << engine_info() << std::endl;
 
   CommandLine::init(argc, argv);
@@ -40,12 +42,11 @@ int main(int argc, char* argv[]) {
   Position::init();
   Bitbases::init();
   Endgames::init();
-  Threads.set(size_t(Options["Threads"]));
-  Search::clear(); // After threads are up
+
+  Engine engine((size_t)Options["Threads"], (size_t)Options["Hash"],
+                (size_t)Options["Eval Cache"]);
   Eval::NNUE::init();
 
-  //UCI::loop(argc, argv);
-  UCI::ChessboardLoop(argc, argv);
-  Threads.set(0);
-  return 0;
+  //UCI::loop(engine, argc, argv);
+  return UCI::ChessboardLoop(engine, argc, argv);
 }
@@ -0,0 +1,371 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <sched.h>
+#endif
+
+#include "benchmark.h"
+#include "engine.h"
+#include "evaluate.h"
+#include "misc.h"
+#include "movegen.h"
+#include "pawns.h"
+#include "perfcounters.h"
+#include "position.h"
+#include "uci.h"
+#include "nnue/nnue_accumulator.h"
+
+using namespace std;
+
+namespace {
+
+  // Results of the timed calls are summed here, so that the compiler cannot
+  // drop the calls as useless.
+  volatile uint64_t Sink;
+
+  int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+          (std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // Kernel is a component to be timed. A call to run() makes one pass over
+  // the positions and returns the number of operations it has done.
+
+  struct Kernel {
+    string name;
+    function<size_t()> run;
+  };
+
+  // Pinning binds the thread to the CPU it runs on for its lifetime, so that
+  // the samples are all taken with the same caches and the same clock.
+
+  struct Pinning {
+#if defined(__linux__) && !defined(__ANDROID__)
+    Pinning() {
+      cpu_set_t cpus;
+      cpu = sched_getcpu();
+      CPU_ZERO(&cpus);
+      CPU_SET(cpu, &cpus);
+      pinned =    cpu >= 0
+               && !sched_getaffinity(0, sizeof(old), &old)
+               && !sched_setaffinity(0, sizeof(cpus), &cpus);
+    }
+   ~Pinning() { if (pinned) sched_setaffinity(0, sizeof(old), &old); }
+
+    cpu_set_t old;
+#endif
+    int cpu = -1;
+    bool pinned = false;
+  };
+
+  // measure() warms up a kernel for half a sample, then takes samples of about
+  // sampleMs milliseconds each. It returns the nanoseconds per operation of the
+  // samples, fastest first. The hardware counters, if open, count the samples,
+  // and totalOps is set to the number of operations they count.
+
+  vector<double> measure(const Kernel& kernel, int sampleMs, int samples,
+                         Perf::Group& perf, size_t& totalOps) {
+
+    vector<double> nsPerOp;
+    int64_t sampleNs = int64_t(sampleMs) * 1000000;
+
+    for (int64_t end = now_ns() + sampleNs / 2; now_ns() < end; )
+        kernel.run();
+
+    totalOps = 0;
+    perf.start();
+
+    for (int i = 0; i < samples; ++i)
+    {
+        size_t ops = 0;
+        int64_t start = now_ns(), elapsed;
+
+        do ops += kernel.run();
+        while ((elapsed = now_ns() - start) < sampleNs);
+
+        nsPerOp.push_back(double(elapsed) / std::max(ops, size_t(1)));
+        totalOps += ops;
+    }
+
+    perf.stop();
+
+    std::sort(nsPerOp.begin(), nsPerOp.end());
+    return nsPerOp;
+  }
+
+} // namespace
+
+
+namespace Bench {
+
+/// microbench() times the hot components of the search one by one, over the
+/// default positions of bench and their legal moves: move generation, do and
+/// undo of a move, alone and with the check info a node searching its moves
+/// computes, check and SEE tests, NNUE and classical evaluations, TT and pawn
+/// hash probes, FEN and packed position codecs. Each component is warmed up,
+/// then timed in several samples with the thread pinned to its CPU, and the
+/// fastest and median samples are reported. The NNUE incremental update is
+/// timed from a computed parent to one of its children. With the
+/// "Perf Counters" option, the hardware events of the samples are reported per
+/// operation as well.
+
+void microbench(int sampleMs, int samples) {
+
+  Engine engine(1, 16, 0);
+  Thread* th = engine.threads.main();
+  Eval::NNUE::NetPtr net = Eval::NNUE::active_net();
+  Eval::NNUE::Accumulator* acc = th->accumulators;
+
+  deque<Position> roots, children;
+  deque<StateInfo> states;
+  vector<vector<Move>> moves;
+  vector<vector<bool>> checks;
+  vector<Key> keys;
+  bool chess960 = false;
+  size_t moveCount = 0;
+
+  sampleMs = std::max(sampleMs, 1);
+  samples = std::max(samples, 1);
+
+  // Set up the positions, after the moves some of them come with. Each root
+  // gets two NNUE accumulators of the main thread: its own and its child's.
+  for (const string& line : default_positions())
+  {
+      if (line.find("setoption") == 0)
+      {
+          chess960 = line.find("true") != string::npos;
+          continue;
+      }
+
+      size_t split = line.find(" moves ");
+      StateListPtr history(new deque<StateInfo>(1));
+      Position p;
+      string token;
+
+      p.set(line.substr(0, split), chess960, &history->back(), th);
+
+      if (split != string::npos)
+          for (istringstream ss(line.substr(split + 7)); ss >> token; )
+          {
+              history->emplace_back();
+              p.do_move(UCI::to_move(p, token), history->back());
+          }
+
+      if (2 * roots.size() + 1 >= size_t(MAX_PLY))
+          break;
+
+      states.emplace_back();
+      roots.emplace_back().set(p.fen(), chess960, &states.back(), th);
+      states.back().accumulator = &acc[2 * (roots.size() - 1)];
+      states.back().accumulator->state[WHITE] = states.back().accumulator->state[BLACK] = Eval::NNUE::INIT;
+
+      moves.emplace_back();
+      checks.emplace_back();
+
+      for (const auto& m : MoveList<LEGAL>(roots.back()))
+      {
+          Position& child = children.emplace_back();
+
+          moves.back().push_back(m);
+          checks.back().push_back(roots.back().gives_check(m));
+
+          // A child keeps its own copy of the root state, whose accumulator is
+          // the root one. do_move() gives the next accumulator to the child.
+          states.emplace_back();
+          child.set(p.fen(), chess960, &states.back(), th);
+          states.back().accumulator = &acc[2 * (roots.size() - 1)];
+          states.emplace_back();
+          child.do_move(m, states.back(), checks.back().back());
+
+          for (const auto& m2 : MoveList<LEGAL>(child))
+              keys.push_back(child.key_after(m2));
+
+          ++moveCount;
+      }
+  }
+
+  // Store every other key, so that the probes find half of them
+  for (size_t i = 0; i < keys.size(); i += 2)
+  {
+      bool found;
+      engine.tt.probe(keys[i], found)->save(keys[i], VALUE_ZERO, false, BOUND_EXACT,
+                                            Depth(1), MOVE_NONE, VALUE_ZERO, engine.tt.generation());
+  }
+
+  // The positions as FEN strings and packed, for their codecs
+  vector<string> fens;
+  vector<PackedPosition> packs;
+
+  for (const Position& p : roots)
+  {
+      fens.push_back(p.fen());
+      packs.push_back(p.pack());
+  }
+
+  vector<Kernel> kernels = {
+    { "generate<LEGAL>", [&]() {
+        for (const Position& p : roots)
+            Sink += MoveList<LEGAL>(p).size();
+        return roots.size();
+    }},
+    { "do_move/undo_move", [&]() {
+        StateInfo st;
+        for (size_t i = 0; i < roots.size(); ++i)
+            for (size_t j = 0; j < moves[i].size(); ++j)
+            {
+                roots[i].do_move(moves[i][j], st, checks[i][j]);
+                roots[i].undo_move(moves[i][j]);
+            }
+        return moveCount;
+    }},
+    { "do_move/check info", [&]() {
+        StateInfo st;
+        for (size_t i = 0; i < roots.size(); ++i)
+            for (size_t j = 0; j < moves[i].size(); ++j)
+            {
+                roots[i].do_move(moves[i][j], st, checks[i][j]);
+                Sink += roots[i].blockers_for_king(WHITE); // As a node searching its moves
+                roots[i].undo_move(moves[i][j]);
+            }
+        return moveCount;
+    }},
+    { "gives_check", [&]() {
+        for (size_t i = 0; i < roots.size(); ++i)
+            for (Move m : moves[i])
+                Sink += roots[i].gives_check(m);
+        return moveCount;
+    }},
+    { "see_ge", [&]() {
+        for (size_t i = 0; i < roots.size(); ++i)
+            for (Move m : moves[i])
+                Sink += roots[i].see_ge(m);
+        return moveCount;
+    }},
+    { "classical evaluation", [&]() {
+        for (const Position& p : roots)
+            Sink += Eval::evaluate_classical(p);
+        return roots.size();
+    }},
+    { "Pawns::probe", [&]() {
+        for (const Position& p : roots)
+            Sink += Pawns::probe(p)->passed_count();
+        return roots.size();
+    }},
+    { "TT probe", [&]() {
+        bool found;
+        for (Key k : keys)
+            Sink += engine.tt.probe(k, found) != nullptr && found;
+        return keys.size();
+    }},
+    { "Position::set", [&]() {
+        StateInfo st;
+        Position p;
+        for (size_t i = 0; i < fens.size(); ++i)
+            Sink += p.set(fens[i], roots[i].is_chess960(), &st, th).key();
+        return fens.size();
+    }},
+    { "Position::fen", [&]() {
+        char fen[MAX_FEN_LENGTH];
+        for (const Position& p : roots)
+            Sink += p.fen(fen) - fen;
+        return roots.size();
+    }},
+    { "Position::pack", [&]() {
+        for (const Position& p : roots)
+            Sink += p.pack().data[31];
+        return roots.size();
+    }},
+    { "Position::unpack", [&]() {
+        StateInfo st;
+        Position p;
+        for (const PackedPosition& pp : packs)
+            Sink += p.unpack(pp, &st, th) ? p.key() : 0;
+        return packs.size();
+    }}
+  };
+
+  if (net)
+  {
+      th->net = net;
+
+      kernels.push_back({ "NNUE full refresh", [&]() {
+          for (const Position& p : roots)
+          {
+              p.state()->accumulator->state[WHITE] = p.state()->accumulator->state[BLACK] = Eval::NNUE::INIT;
+              Sink += Eval::NNUE::evaluate(p);
+          }
+          return roots.size();
+      }});
+
+      kernels.push_back({ "NNUE incremental", [&]() {
+          for (const Position& p : children)
+          {
+              p.state()->accumulator->state[WHITE] = p.state()->accumulator->state[BLACK] = Eval::NNUE::EMPTY;
+              Sink += Eval::NNUE::evaluate(p);
+          }
+          return children.size();
+      }});
+  }
+
+  Pinning pinning;
+  Perf::Group perf;
+  string perfTable;
+
+  if (Options["Perf Counters"] && !perf.open())
+      perfTable = "\nHardware counters are not available\n";
+
+  cerr << "\nMicrobench of " << roots.size() << " positions, " << moveCount << " moves and "
+       << keys.size() << " TT keys, " << samples << " samples of " << sampleMs << " ms, "
+       << (pinning.pinned ? "pinned to CPU " + std::to_string(pinning.cpu) : string("not pinned"))
+       << (net ? "" : ", no NNUE network loaded") << "\n\n"
+       << std::left << std::setw(22) << "Component" << std::right
+       << std::setw(12) << "ops/pass" << std::setw(14) << "ns/op best"
+       << std::setw(14) << "ns/op median" << std::setw(16) << "ops/second" << "\n";
+
+  for (const Kernel& k : kernels)
+  {
+      size_t ops = k.run(), totalOps;
+      vector<double> ns = measure(k, sampleMs, samples, perf, totalOps);
+      double median = ns[ns.size() / 2];
+
+      if (perf.is_open())
+          perfTable += Perf::row(k.name, perf.read(), double(totalOps));
+
+      cerr << std::left << std::setw(22) << k.name << std::right << std::fixed << std::setprecision(1)
+           << std::setw(12) << ops << std::setw(14) << ns.front() << std::setw(14) << median
+           << std::setprecision(0) << std::setw(16) << 1e9 / median << std::defaultfloat << endl;
+  }
+
+  if (perf.is_open())
+      cerr << "\n" << Perf::header("Counts per op") << perfTable;
+  else
+      cerr << perfTable;
+
+  th->net = nullptr;
+}
+
+} // namespace Bench
@@ -39,10 +39,12 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 }
 #endif
 
+#include <atomic>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <thread>
 #include <vector>
 #include <cstdlib>
 
@@ -67,69 +69,293 @@ namespace {
 /// DD-MM-YY and show in engine_info.
 const string Version = "13";
 
-/// Our fancy logging facility. The trick here is to replace cin.rdbuf() and
-/// cout.rdbuf() with two Tie objects that tie cin and cout to a file stream. We
-/// can toggle the logging of std::cout and std:cin at runtime whilst preserving
-/// usual I/O functionality, all without changing a single line of code!
-/// Idea from http://groups.google.com/group/comp.lang.c++/msg/1d941c0f26ea0d81
+/// Our output path. Whatever is written to std::cout, directly or through
+/// sync_cout, is cut into messages in a buffer of the writing thread: a line
+/// at a time, or a whole sync_cout ... sync_endl block. The messages are posted
+/// to a bounded lock-free queue, and a writer thread of its own writes them to
+/// stdout and to the debug log file, if any. So the messages of the threads are
+/// never interleaved, and posting one is only a few atomic operations.
+///
+/// When stdout does not keep up and the queue is full, the 'info' lines are
+/// coalesced: the last one waits in a slot of its own, and those it replaces
+/// are dropped. The other messages wait for room, since they cannot be lost.
+
+enum MessageKind { OUTPUT, INPUT, LOG_FILE };
 
-struct Tie: public streambuf { // MSVC requires split streambuf for cin and cout
+class OutputQueue {
 
-  Tie(streambuf* b, streambuf* l) : buf(b), logBuf(l) {}
+  static constexpr size_t Capacity = 1024; // A power of two
 
-  int sync() override { return logBuf->pubsync(), buf->pubsync(); }
-  int overflow(int c) override { return log(buf->sputc((char)c), "<< "); }
-  int underflow() override { return buf->sgetc(); }
-  int uflow() override { return log(buf->sbumpc(), ">> "); }
+  struct Cell {
+    std::atomic<size_t> seq; // Index of the message the cell waits for, plus one when full
+    MessageKind kind;
+    string text;
+  };
 
-  streambuf *buf, *logBuf;
+public:
+  OutputQueue() : stdoutBuf(cout.rdbuf()) {
 
-  int log(int c, const char* prefix) {
+    for (size_t i = 0; i < Capacity; ++i)
+        cells[i].seq = i;
 
-    static int last = '\n'; // Single log file
+    writer = std::thread(&OutputQueue::write_loop, this);
+    cout.rdbuf(&lineBuf);
+    Open = this;
+  }
 
-    if (last == '\n')
-        logBuf->sputn(prefix, 3);
+ ~OutputQueue() {
 
-    return last = logBuf->sputc((char)c);
+    lineBuf.pubsync(); // Anything left by the exiting thread
+    closing = true;
+    bell.fetch_add(1);
+    bell.notify_all();
+    writer.join();
+    cout.rdbuf(stdoutBuf);
+    Open = nullptr;
   }
-};
 
-class Logger {
+  // Posts a message, or writes it at once if the queue is not running
+  static void post(MessageKind kind, string& text) {
 
-  Logger() : in(cin.rdbuf(), file.rdbuf()), out(cout.rdbuf(), file.rdbuf()) {}
- ~Logger() { start(""); }
+    if (OutputQueue* q = Open)
+        q->push(kind, text);
 
-  ofstream file;
-  Tie in, out;
+    else if (kind == OUTPUT)
+        cout.rdbuf()->sputn(text.data(), text.size()), cout.rdbuf()->pubsync();
 
-public:
-  static void start(const std::string& fname) {
+    text.clear();
+  }
+
+  // LineBuf is the stream buffer of std::cout and of the sync_cout streams. It
+  // collects the characters in the buffer of the calling thread, and posts them
+  // a line at a time, or all at once at the end of a sync_cout block.
+
+  struct LineBuf : public streambuf {
+
+    int overflow(int c) override {
+
+      if (c != EOF)
+      {
+          char ch = char(c);
+          xsputn(&ch, 1);
+      }
+      return c;
+    }
+
+    streamsize xsputn(const char* s, streamsize n) override {
+
+      pending.append(s, size_t(n));
+
+      size_t eol = pending.rfind('\n');
+      if (!holding && eol != string::npos)
+      {
+          string rest = pending.substr(eol + 1);
+          pending.resize(eol + 1);
+          post(OUTPUT, pending);
+          pending = rest;
+      }
+      return n;
+    }
+
+    int sync() override {
+
+      if (!holding && !pending.empty())
+          post(OUTPUT, pending);
+      return 0;
+    }
+
+    static thread_local string pending;
+    static thread_local bool holding; // Within a sync_cout block
+  };
+
+  // Tie is the stream buffer of std::cin while logging, which posts the lines
+  // read to the log.
+
+  struct Tie : public streambuf {
+
+    explicit Tie(streambuf* b) : buf(b) {}
+
+    int sync() override { return buf->pubsync(); }
+    int underflow() override { return buf->sgetc(); }
+    int uflow() override {
 
-    static Logger l;
+      int c = buf->sbumpc();
 
-    if (!fname.empty() && !l.file.is_open())
+      if (c != EOF && (line += char(c), c == '\n'))
+          post(INPUT, line);
+      return c;
+    }
+
+    streambuf* buf;
+    string line;
+  };
+
+  static OutputStats stats() {
+
+    OutputQueue* q = Open;
+    return q ? OutputStats{ q->messages, q->coalesced, q->dropped, q->waits } : OutputStats{};
+  }
+
+  static LineBuf lineBuf;
+
+private:
+  static std::atomic<OutputQueue*> Open;
+
+  // Vyukov's bounded queue: a producer claims the next index with a CAS on the
+  // tail, fills the cell and then publishes it through its sequence number.
+  bool try_push(MessageKind kind, string& text) {
+
+    size_t pos = tail.load(std::memory_order_relaxed);
+    Cell* c;
+
+    while (true)
     {
-        l.file.open(fname, ifstream::out);
+        c = &cells[pos & (Capacity - 1)];
+        intptr_t diff = intptr_t(c->seq.load(std::memory_order_acquire)) - intptr_t(pos);
+
+        if (diff == 0 && tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            break;
+
+        if (diff < 0)
+            return false; // Full
+
+        if (diff > 0)
+            pos = tail.load(std::memory_order_relaxed);
+    }
 
-        if (!l.file.is_open())
+    c->kind = kind;
+    c->text = std::move(text);
+    c->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  void push(MessageKind kind, string& text) {
+
+    ++messages;
+
+    // An 'info' line joins the waiting one, if any, so that it is not written
+    // before an older one.
+    if (kind == OUTPUT && text.compare(0, 4, "info") == 0)
+    {
+        if (latest.load() || !try_push(kind, text))
+        {
+            ++coalesced;
+            if (string* old = latest.exchange(new string(std::move(text))))
+                ++dropped, delete old;
+        }
+    }
+    else
+    {
+        // The waiting 'info' line goes first
+        if (string* info = latest.exchange(nullptr))
         {
-            cerr << "Unable to open debug log file " << fname << endl;
-            exit(EXIT_FAILURE);
+            push_or_wait(OUTPUT, *info);
+            delete info;
         }
 
-        cin.rdbuf(&l.in);
-        cout.rdbuf(&l.out);
+        push_or_wait(kind, text);
     }
-    else if (fname.empty() && l.file.is_open())
+
+    bell.fetch_add(1);
+    bell.notify_all();
+  }
+
+  void push_or_wait(MessageKind kind, string& text) {
+
+    if (try_push(kind, text))
+        return;
+
+    ++waits;
+
+    do {
+        bell.fetch_add(1);
+        bell.notify_all();
+        std::this_thread::yield();
+    } while (!try_push(kind, text));
+  }
+
+  // The writer thread is the only consumer, it takes the cells in order
+  bool pop(MessageKind& kind, string& text) {
+
+    Cell& c = cells[head & (Capacity - 1)];
+
+    if (c.seq.load(std::memory_order_acquire) != head + 1)
+        return false;
+
+    kind = c.kind;
+    text = std::move(c.text);
+    c.text.clear();
+    c.seq.store(head + Capacity, std::memory_order_release);
+    ++head;
+    return true;
+  }
+
+  void write(MessageKind kind, const string& text) {
+
+    if (kind == LOG_FILE)
+    {
+        log.close();
+        if (!text.empty())
+            log.open(text, ios::app); // Created by start_logger()
+        return;
+    }
+
+    if (kind == OUTPUT)
+        stdoutBuf->sputn(text.data(), text.size());
+
+    if (log.is_open())
+        for (size_t b = 0, e; b < text.size(); b = e + 1)
+        {
+            e = std::min(text.find('\n', b), text.size() - 1);
+            log << (kind == OUTPUT ? "<< " : ">> ") << text.substr(b, e - b + 1);
+        }
+  }
+
+  void write_loop() {
+
+    MessageKind kind;
+    string text;
+
+    while (true)
     {
-        cout.rdbuf(l.out.buf);
-        cin.rdbuf(l.in.buf);
-        l.file.close();
+        uint32_t ring = bell.load();
+        bool any = false;
+
+        while (pop(kind, text))
+            write(kind, text), any = true;
+
+        if (string* info = latest.exchange(nullptr))
+            write(OUTPUT, *info), delete info, any = true;
+
+        if (any)
+        {
+            stdoutBuf->pubsync();
+            log.flush();
+        }
+        else if (closing)
+            break;
+        else
+            bell.wait(ring);
     }
   }
+
+  Cell cells[Capacity];
+  std::atomic<size_t> tail = 0;
+  size_t head = 0;
+  std::atomic<string*> latest = nullptr; // The 'info' line waiting for room
+  std::atomic<uint64_t> messages = 0, coalesced = 0, dropped = 0, waits = 0;
+  std::atomic<bool> closing = false;
+  ParkingWord bell;
+  streambuf* stdoutBuf;
+  ofstream log;
+  std::thread writer;
 };
 
+std::atomic<OutputQueue*> OutputQueue::Open;
+OutputQueue::LineBuf OutputQueue::lineBuf;
+thread_local string OutputQueue::LineBuf::pending;
+thread_local bool OutputQueue::LineBuf::holding;
+
 } // namespace
 
 
@@ -282,25 +508,75 @@ void dbg_print() {
 }
 
 
-/// Used to serialize access to std::cout to avoid multiple threads writing at
-/// the same time.
+/// start_output() starts the output queue, it is called once at startup before
+/// anything is written to std::cout.
 
-std::ostream& operator<<(std::ostream& os, SyncCout sc) {
+void start_output() {
 
-  static std::mutex m;
+  static OutputQueue queue;
+}
+
+
+/// sync_stream() returns the stream of sync_cout for the calling thread. It
+/// writes to the same buffer as std::cout, but has its own formatting state.
+
+std::ostream& sync_stream() {
+
+  thread_local ostream os(&OutputQueue::lineBuf);
+  return os;
+}
+
+
+/// Used to post the output of sync_cout as a whole, in one message
+
+std::ostream& operator<<(std::ostream& os, SyncCout sc) {
 
   if (sc == IO_LOCK)
-      m.lock();
+      OutputQueue::LineBuf::holding = true;
 
   if (sc == IO_UNLOCK)
-      m.unlock();
+  {
+      OutputQueue::LineBuf::holding = false;
+      os.flush();
+  }
 
   return os;
 }
 
 
-/// Trampoline helper to avoid moving Logger to misc.h
-void start_logger(const std::string& fname) { Logger::start(fname); }
+/// output_stats() returns the counts of messages of the output queue
+
+OutputStats output_stats() { return OutputQueue::stats(); }
+
+
+/// start_logger() starts writing the input and output to a log file, or stops
+/// it with an empty file name. The file is created here, so that we can exit at
+/// once if it cannot be, then written by the writer thread.
+
+void start_logger(const std::string& fname) {
+
+  static OutputQueue::Tie in(cin.rdbuf());
+  static string current;
+
+  if (!fname.empty() && current.empty())
+  {
+      if (!ofstream(fname, ifstream::out).is_open())
+      {
+          cerr << "Unable to open debug log file " << fname << endl;
+          exit(EXIT_FAILURE);
+      }
+
+      string name = current = fname;
+      OutputQueue::post(LOG_FILE, name);
+      cin.rdbuf(&in);
+  }
+  else if (fname.empty() && !current.empty())
+  {
+      cin.rdbuf(in.buf);
+      current.clear();
+      OutputQueue::post(LOG_FILE, current);
+  }
+}
 
 
 /// prefetch() preloads the given address in L1/L2 cache. This is a non-blocking
@@ -49,6 +49,11 @@ inline TimePoint now() {
         (std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
+inline int64_t now_us() { // Finer grained now(), for latencies
+  return std::chrono::duration_cast<std::chrono::microseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 template<class Entry, int Size>
 struct HashTable {
   Entry* operator[](Key key) { return &table[(uint32_t)key & (Size - 1)]; }
@@ -58,10 +63,21 @@ private:
 };
 
 
+/// OutputStats counts the messages posted to the output queue, the 'info' lines
+/// coalesced and dropped when stdout did not keep up, and the waits for room of
+/// the other messages. See start_output().
+
+struct OutputStats {
+  uint64_t messages, coalesced, dropped, waits;
+};
+
 enum SyncCout { IO_LOCK, IO_UNLOCK };
 std::ostream& operator<<(std::ostream&, SyncCout);
+std::ostream& sync_stream();
+void start_output();
+OutputStats output_stats();
 
-#define sync_cout std::cout << IO_LOCK
+#define sync_cout sync_stream() << IO_LOCK
 #define sync_endl std::endl << IO_UNLOCK
 
 // `ptr` must point to an array of size at least
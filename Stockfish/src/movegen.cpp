@@ -16,6 +16,7 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cassert>
 
 #include "movegen.h"
@@ -253,6 +254,202 @@ namespace {
     return moveList;
   }
 
+
+
+  // generate_king_moves() generates the king moves to the squares which are not
+  // attacked once the king has left its own, so that it does not hide a slider
+  // checking it from the squares behind.
+
+  template<Color Us>
+  ExtMove* generate_king_moves(const Position& pos, ExtMove* moveList) {
+
+    const Square ksq = pos.square<KING>(Us);
+    const Bitboard occupied = pos.pieces() ^ ksq;
+    Bitboard b = attacks_bb<KING>(ksq) & ~pos.pieces(Us);
+
+    while (b)
+    {
+        Square to = pop_lsb(&b);
+        if (!(pos.attackers_to(to, occupied) & pos.pieces(~Us)))
+            *moveList++ = make_move(ksq, to);
+    }
+
+    return moveList;
+  }
+
+
+  // generate_legal_moves() is generate_moves() for the pieces which may be
+  // pinned, and then only move along the line of the pin.
+
+  template<Color Us, PieceType Pt>
+  ExtMove* generate_legal_moves(const Position& pos, ExtMove* moveList, Bitboard piecesToMove,
+                                Bitboard target, Bitboard pinned) {
+
+    const Square ksq = pos.square<KING>(Us);
+    Bitboard bb = piecesToMove & pos.pieces(Pt);
+
+    while (bb)
+    {
+        Square from = pop_lsb(&bb);
+        Bitboard b = attacks_bb<Pt>(from, pos.pieces()) & target;
+
+        if (pinned & from)
+            b &= line_bb(ksq, from);
+
+        while (b)
+            *moveList++ = make_move(from, pop_lsb(&b));
+    }
+
+    return moveList;
+  }
+
+
+  // generate_legal() generates the legal moves without testing them one by one,
+  // in the order of generate<EVASIONS> and generate<NON_EVASIONS>. In check the
+  // pieces other than the king may only capture the checker or block its check.
+  // The pinned pieces may only move along the line of the pin: a pawn pushes if
+  // pinned on its file and captures the pinner if pinned on a diagonal.
+  //
+  // Both rules apply together, also to a pinned piece in check. Usually no move
+  // passes both, but blockers_for_king() looks through the other sliders, so a
+  // piece standing behind the checker, on the line from our king, counts as
+  // pinned by the slider behind it. Such a piece may still capture the checker.
+  //
+  // En passant captures, which take two pieces off the board, and castling,
+  // whose path must not be attacked, are checked on the board before being
+  // generated.
+
+  template<Color Us>
+  ExtMove* generate_legal(const Position& pos, ExtMove* moveList) {
+
+    constexpr Color     Them     = ~Us;
+    constexpr Bitboard  TRank7BB = (Us == WHITE ? Rank7BB    : Rank2BB);
+    constexpr Bitboard  TRank3BB = (Us == WHITE ? Rank3BB    : Rank6BB);
+    constexpr Direction Up       = pawn_push(Us);
+    constexpr Direction UpRight  = (Us == WHITE ? NORTH_EAST : SOUTH_WEST);
+    constexpr Direction UpLeft   = (Us == WHITE ? NORTH_WEST : SOUTH_EAST);
+
+    const Square ksq = pos.square<KING>(Us);
+    const Bitboard checkers = pos.checkers();
+    const Bitboard pinned = pos.blockers_for_king(Us) & pos.pieces(Us);
+
+    if (checkers)
+    {
+        moveList = generate_king_moves<Us>(pos, moveList);
+
+        if (more_than_one(checkers))
+            return moveList; // Double check, only a king move can save the day
+    }
+
+    Bitboard target  = checkers ? between_bb(ksq, lsb(checkers)) | checkers : ~pos.pieces(Us);
+    Bitboard enemies = pos.pieces(Them) & target;
+    Bitboard emptySquares = ~pos.pieces();
+
+    // The pawns which may push, and those which may capture to either side
+    Bitboard pawns = pos.pieces(Us, PAWN);
+    Bitboard pushers = (pawns & ~pinned) | (pawns & pinned & file_bb(ksq));
+    Bitboard rightCapturers = pawns & ~pinned, leftCapturers = pawns & ~pinned;
+
+    for (Bitboard b = pawns & pinned & ~file_bb(ksq); b; )
+    {
+        Square s = pop_lsb(&b);
+
+        if (line_bb(ksq, s) & shift<UpRight>(square_bb(s)))
+            rightCapturers |= s;
+        else if (line_bb(ksq, s) & shift<UpLeft>(square_bb(s)))
+            leftCapturers |= s;
+    }
+
+    // Single and double pawn pushes, no promotions
+    Bitboard b1 = shift<Up>(pushers & ~TRank7BB) & emptySquares;
+    Bitboard b2 = shift<Up>(b1 & TRank3BB) & emptySquares & target;
+    b1 &= target;
+
+    while (b1)
+    {
+        Square to = pop_lsb(&b1);
+        *moveList++ = make_move(to - Up, to);
+    }
+
+    while (b2)
+    {
+        Square to = pop_lsb(&b2);
+        *moveList++ = make_move(to - Up - Up, to);
+    }
+
+    // Promotions and underpromotions
+    const Square theirKsq = pos.square<KING>(Them);
+
+    b1 = shift<UpRight>(rightCapturers & TRank7BB) & enemies;
+    b2 = shift<UpLeft >(leftCapturers  & TRank7BB) & enemies;
+    Bitboard b3 = shift<Up>(pushers & TRank7BB) & emptySquares & target;
+
+    while (b1)
+        moveList = make_promotions<NON_EVASIONS, UpRight>(moveList, pop_lsb(&b1), theirKsq);
+
+    while (b2)
+        moveList = make_promotions<NON_EVASIONS, UpLeft >(moveList, pop_lsb(&b2), theirKsq);
+
+    while (b3)
+        moveList = make_promotions<NON_EVASIONS, Up     >(moveList, pop_lsb(&b3), theirKsq);
+
+    // Standard and en passant captures
+    b1 = shift<UpRight>(rightCapturers & ~TRank7BB) & enemies;
+    b2 = shift<UpLeft >(leftCapturers  & ~TRank7BB) & enemies;
+
+    while (b1)
+    {
+        Square to = pop_lsb(&b1);
+        *moveList++ = make_move(to - UpRight, to);
+    }
+
+    while (b2)
+    {
+        Square to = pop_lsb(&b2);
+        *moveList++ = make_move(to - UpLeft, to);
+    }
+
+    if (pos.ep_square() != SQ_NONE)
+    {
+        Square capsq = pos.ep_square() - Up;
+
+        // Only the capture of a checking pawn, or the block of a slider, may
+        // resolve a check. The sliders are found on the board after the
+        // capture.
+        if (!(checkers & ~square_bb(capsq) & pos.pieces(KNIGHT, PAWN)))
+            for (b1 = pos.pieces(Us, PAWN) & pawn_attacks_bb(Them, pos.ep_square()); b1; )
+            {
+                Square from = pop_lsb(&b1);
+                Bitboard occupied = (pos.pieces() ^ from ^ capsq) | pos.ep_square();
+
+                if (   !(attacks_bb<  ROOK>(ksq, occupied) & pos.pieces(Them, QUEEN, ROOK))
+                    && !(attacks_bb<BISHOP>(ksq, occupied) & pos.pieces(Them, QUEEN, BISHOP)))
+                    *moveList++ = make<EN_PASSANT>(from, pos.ep_square());
+            }
+    }
+
+    moveList = generate_legal_moves<Us, KNIGHT>(pos, moveList, pos.pieces(Us) & ~pinned, target, pinned);
+    moveList = generate_legal_moves<Us, BISHOP>(pos, moveList, pos.pieces(Us), target, pinned);
+    moveList = generate_legal_moves<Us,   ROOK>(pos, moveList, pos.pieces(Us), target, pinned);
+    moveList = generate_legal_moves<Us,  QUEEN>(pos, moveList, pos.pieces(Us), target, pinned);
+
+    if (!checkers)
+    {
+        moveList = generate_king_moves<Us>(pos, moveList);
+
+        if (pos.can_castle(Us & ANY_CASTLING))
+            for (CastlingRights cr : { Us & KING_SIDE, Us & QUEEN_SIDE } )
+                if (!pos.castling_impeded(cr) && pos.can_castle(cr))
+                {
+                    Move m = make<CASTLING>(ksq, pos.castling_rook_square(cr));
+                    if (pos.legal(m))
+                        *moveList++ = m;
+                }
+    }
+
+    return moveList;
+  }
+
 } // namespace
 
 
@@ -341,23 +538,18 @@ ExtMove* generate<EVASIONS>(const Position& pos, ExtMove* moveList) {
 }
 
 
-/// generate<LEGAL> generates all the legal moves in the given position
+/// generate<LEGAL> generates all the legal moves in the given position, see
+/// generate_legal().
 
 template<>
 ExtMove* generate<LEGAL>(const Position& pos, ExtMove* moveList) {
 
-  Color us = pos.side_to_move();
-  Bitboard pinned = pos.blockers_for_king(us) & pos.pieces(us);
-  Square ksq = pos.square<KING>(us);
-  ExtMove* cur = moveList;
-
-  moveList = pos.checkers() ? generate<EVASIONS    >(pos, moveList)
-                            : generate<NON_EVASIONS>(pos, moveList);
-  while (cur != moveList)
-      if (  ((pinned && pinned & from_sq(*cur)) || from_sq(*cur) == ksq || type_of(*cur) == EN_PASSANT)
-          && !pos.legal(*cur))
-          *cur = (--moveList)->move;
-      else
-          ++cur;
+  [[maybe_unused]] ExtMove* begin = moveList;
+
+  moveList = pos.side_to_move() == WHITE ? generate_legal<WHITE>(pos, moveList)
+                                         : generate_legal<BLACK>(pos, moveList);
+
+  assert(std::all_of(begin, moveList, [&](Move m) { return pos.pseudo_legal(m) && pos.legal(m); }));
+
   return moveList;
 }
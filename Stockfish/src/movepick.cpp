@@ -19,6 +19,7 @@
 #include <cassert>
 
 #include "movepick.h"
+#include "profiler.h"
 
 namespace {
 
@@ -146,6 +147,8 @@ Move MovePicker::select(Pred filter) {
 /// moves left, picking the move with the highest score from a list of generated moves.
 Move MovePicker::next_move(bool skipQuiets) {
 
+  Profiler::Scope<Profiler::MOVEGEN> scope;
+
 top:
   switch (stage) {
 
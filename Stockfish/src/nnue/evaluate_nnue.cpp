@@ -19,11 +19,15 @@
 // Code for calculating NNUE evaluation function
 
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <set>
 
 #include "../evaluate.h"
 #include "../position.h"
 #include "../misc.h"
+#include "../thread.h"
+#include "../profiler.h"
 #include "../uci.h"
 #include "../types.h"
 
@@ -31,14 +35,13 @@
 
 namespace Eval::NNUE {
 
-  // Input feature converter
-  LargePagePtr<FeatureTransformer> feature_transformer;
-
-  // Evaluation function
-  AlignedPtr<Network> network;
-
-  // Evaluation function file name
-  std::string fileName;
+  // Networks resident in memory, by file name, and the one used by new
+  // searches. The map is guarded by the mutex, activeNet is only accessed
+  // through std::atomic_load() and std::atomic_store().
+  std::mutex registryMutex;
+  std::map<std::string, NetPtr> registry;
+  NetPtr activeNet;
+  uint64_t loadCount;
 
   namespace Detail {
 
@@ -71,10 +74,10 @@ namespace Eval::NNUE {
   }  // namespace Detail
 
   // Initialize the evaluation function parameters
-  void Initialize() {
+  void Initialize(Net& net) {
 
-    Detail::Initialize(feature_transformer);
-    Detail::Initialize(network);
+    Detail::Initialize(net.featureTransformer);
+    Detail::Initialize(net.network);
   }
 
   // Read network header
@@ -92,20 +95,22 @@ namespace Eval::NNUE {
   }
 
   // Read network parameters
-  bool ReadParameters(std::istream& stream) {
+  bool ReadParameters(std::istream& stream, Net& net) {
 
     std::uint32_t hash_value;
     std::string architecture;
     if (!ReadHeader(stream, &hash_value, &architecture)) return false;
     if (hash_value != kHashValue) return false;
-    if (!Detail::ReadParameters(stream, *feature_transformer)) return false;
-    if (!Detail::ReadParameters(stream, *network)) return false;
+    if (!Detail::ReadParameters(stream, *net.featureTransformer)) return false;
+    if (!Detail::ReadParameters(stream, *net.network)) return false;
     return stream && stream.peek() == std::ios::traits_type::eof();
   }
 
   // Evaluation function. Perform differential calculation.
   Value evaluate(const Position& pos) {
 
+    Profiler::Scope<Profiler::EVAL_NNUE> scope;
+
     // We manually align the arrays on the stack because with gcc < 9.3
     // overaligning stack variables with alignas() doesn't work correctly.
 
@@ -115,30 +120,120 @@ namespace Eval::NNUE {
     TransformedFeatureType transformed_features_unaligned[
       FeatureTransformer::kBufferSize + alignment / sizeof(TransformedFeatureType)];
     char buffer_unaligned[Network::kBufferSize + alignment];
+    char scratch_unaligned[sizeof(Accumulator) + alignment];
 
     auto* transformed_features = align_ptr_up<alignment>(&transformed_features_unaligned[0]);
     auto* buffer = align_ptr_up<alignment>(&buffer_unaligned[0]);
+    auto* scratch = align_ptr_up<alignment>(&scratch_unaligned[0]);
 #else
     alignas(alignment)
       TransformedFeatureType transformed_features[FeatureTransformer::kBufferSize];
     alignas(alignment) char buffer[Network::kBufferSize];
+    alignas(alignment) char scratch[sizeof(Accumulator)];
 #endif
 
     ASSERT_ALIGNED(transformed_features, alignment);
     ASSERT_ALIGNED(buffer, alignment);
+    ASSERT_ALIGNED(scratch, alignment);
+
+    // Positions which are not being searched (e.g. the ones set up for 'eval'
+    // or for tracing) have no accumulator of their own, so we lend them a
+    // temporary one for the duration of this call.
+    // They are evaluated with the active network, while searched positions
+    // use the one their thread has been given for the whole search.
+    StateInfo* st = pos.state();
+    const bool lent = !st->accumulator;
+    NetPtr active;
 
-    feature_transformer->Transform(pos, transformed_features);
-    const auto output = network->Propagate(transformed_features, buffer);
+    if (lent)
+    {
+        st->accumulator = reinterpret_cast<Accumulator*>(&scratch[0]);
+        st->accumulator->state[WHITE] = st->accumulator->state[BLACK] = INIT;
+        active = active_net();
+    }
+
+    const Net& net = lent ? *active : *pos.this_thread()->net;
+
+    net.featureTransformer->Transform(pos, transformed_features);
+    const auto output = net.network->Propagate(transformed_features, buffer);
+
+    if (lent)
+        st->accumulator = nullptr;
 
     return static_cast<Value>(output[0] / FV_SCALE);
   }
 
-  // Load eval, from a file stream or a memory stream
+  // Load eval, from a file stream or a memory stream. On success the network
+  // is added to the resident ones, replacing any with the same name, and
+  // becomes the active one. On failure the active network is left untouched.
   bool load_eval(std::string name, std::istream& stream) {
 
-    Initialize();
-    fileName = name;
-    return ReadParameters(stream);
+    auto net = std::make_shared<Net>();
+    Initialize(*net);
+
+    if (!ReadParameters(stream, *net))
+        return false;
+
+    net->name = name;
+
+    {
+        std::lock_guard<std::mutex> lk(registryMutex);
+        net->salt = ++loadCount * 0xD6E8FEB86659FD93ULL;
+        registry[name] = net;
+    }
+
+    std::atomic_store(&activeNet, NetPtr(net));
+    return true;
+  }
+
+  // The network used by new searches, may be null if none has been loaded
+  NetPtr active_net() {
+
+    return std::atomic_load(&activeNet);
+  }
+
+  // Look up a resident network by name, returns null if not loaded
+  NetPtr find_net(const std::string& name) {
+
+    std::lock_guard<std::mutex> lk(registryMutex);
+    auto it = registry.find(name);
+    return it != registry.end() ? it->second : nullptr;
+  }
+
+  // Make a resident network the active one, without reloading it
+  bool select_net(const std::string& name) {
+
+    NetPtr net = find_net(name);
+    if (net)
+        std::atomic_store(&activeNet, net);
+
+    return bool(net);
+  }
+
+  // Drop a resident network. Searches using it keep it alive until they end.
+  // The active network cannot be unloaded.
+  bool unload_net(const std::string& name) {
+
+    NetPtr active = active_net();
+
+    std::lock_guard<std::mutex> lk(registryMutex);
+    auto it = registry.find(name);
+    if (it == registry.end() || it->second == active)
+        return false;
+
+    registry.erase(it);
+    return true;
+  }
+
+  // Names of the resident networks, in alphabetical order
+  std::vector<std::string> resident_nets() {
+
+    std::vector<std::string> names;
+    std::lock_guard<std::mutex> lk(registryMutex);
+    for (const auto& entry : registry)
+        names.push_back(entry.first);
+
+    return names;
   }
 
 } // namespace Eval::NNUE
@@ -24,6 +24,7 @@
 #include "nnue_feature_transformer.h"
 
 #include <memory>
+#include <string>
 
 namespace Eval::NNUE {
 
@@ -54,6 +55,16 @@ namespace Eval::NNUE {
   template <typename T>
   using LargePagePtr = std::unique_ptr<T, LargePageDeleter<T>>;
 
+  // A network resident in memory. Networks are reference counted, so that a
+  // search keeps using the one it started with while another one is loaded
+  // and swapped in, or while it is unloaded.
+  struct Net {
+    std::string name;
+    Key salt; // Tells apart the evaluations of different networks
+    LargePagePtr<FeatureTransformer> featureTransformer;
+    AlignedPtr<Network> network;
+  };
+
 }  // namespace Eval::NNUE
 
 #endif // #ifndef NNUE_EVALUATE_NNUE_H_INCLUDED
@@ -353,6 +353,11 @@ namespace Eval::NNUE::Layers {
       const __m64 kZeros = _mm_setzero_si64();
       const auto input_vector = reinterpret_cast<const __m64*>(input);
 
+#elif defined(USE_NEON_DOTPROD)
+      constexpr IndexType kNumChunks = kPaddedInputDimensions / kSimdWidth;
+      static_assert(kNumChunks % 2 == 0);
+      const auto input_vector = reinterpret_cast<const int8x16_t*>(input);
+
 #elif defined(USE_NEON)
       constexpr IndexType kNumChunks = kPaddedInputDimensions / kSimdWidth;
       const auto input_vector = reinterpret_cast<const int8x8_t*>(input);
@@ -404,6 +409,18 @@ namespace Eval::NNUE::Layers {
         sum = _mm_add_pi32(sum, _mm_unpackhi_pi32(sum, sum));
         output[i] = _mm_cvtsi64_si32(sum);
 
+#elif defined(USE_NEON_DOTPROD)
+        // The inputs are clipped to [0, 127], so they can be used as signed
+        // bytes. Two accumulators hide the latency of sdot.
+        int32x4_t sum0 = vdupq_n_s32(0);
+        int32x4_t sum1 = vdupq_n_s32(0);
+        const auto row = reinterpret_cast<const int8x16_t*>(&weights_[offset]);
+        for (IndexType j = 0; j < kNumChunks; j += 2) {
+          sum0 = vdotq_s32(sum0, input_vector[j + 0], row[j + 0]);
+          sum1 = vdotq_s32(sum1, input_vector[j + 1], row[j + 1]);
+        }
+        output[i] = vaddvq_s32(vaddq_s32(sum0, sum1)) + biases_[i];
+
 #elif defined(USE_NEON)
         int32x4_t sum = {biases_[i]};
         const auto row = reinterpret_cast<const int8x8_t*>(&weights_[offset]);
@@ -134,18 +134,20 @@ namespace Eval::NNUE::Layers {
       constexpr IndexType kStart = kNumChunks * kSimdWidth;
 
   #elif defined(USE_NEON)
-      constexpr IndexType kNumChunks = kInputDimensions / (kSimdWidth / 2);
-      const int8x8_t kZero = {0};
+      constexpr IndexType kNumChunks = kInputDimensions / kSimdWidth;
+      const int8x16_t kZero = vdupq_n_s8(0);
       const auto in = reinterpret_cast<const int32x4_t*>(input);
-      const auto out = reinterpret_cast<int8x8_t*>(output);
+      const auto out = reinterpret_cast<int8x16_t*>(output);
       for (IndexType i = 0; i < kNumChunks; ++i) {
-        int16x8_t shifted;
-        const auto pack = reinterpret_cast<int16x4_t*>(&shifted);
-        pack[0] = vqshrn_n_s32(in[i * 2 + 0], kWeightScaleBits);
-        pack[1] = vqshrn_n_s32(in[i * 2 + 1], kWeightScaleBits);
-        out[i] = vmax_s8(vqmovn_s16(shifted), kZero);
+        const int16x8_t words0 = vcombine_s16(
+            vqshrn_n_s32(in[i * 4 + 0], kWeightScaleBits),
+            vqshrn_n_s32(in[i * 4 + 1], kWeightScaleBits));
+        const int16x8_t words1 = vcombine_s16(
+            vqshrn_n_s32(in[i * 4 + 2], kWeightScaleBits),
+            vqshrn_n_s32(in[i * 4 + 3], kWeightScaleBits));
+        out[i] = vmaxq_s8(vcombine_s8(vqmovn_s16(words0), vqmovn_s16(words1)), kZero);
       }
-      constexpr IndexType kStart = kNumChunks * (kSimdWidth / 2);
+      constexpr IndexType kStart = kNumChunks * kSimdWidth;
   #else
       constexpr IndexType kStart = 0;
   #endif
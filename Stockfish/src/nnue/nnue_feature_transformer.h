@@ -24,6 +24,7 @@
 #include "nnue_common.h"
 #include "nnue_architecture.h"
 #include "features/index_list.h"
+#include "../thread.h"
 
 #include <cstring> // std::memset()
 
@@ -72,7 +73,8 @@ namespace Eval::NNUE {
   #define vec_store(a,b) *(a)=(b)
   #define vec_add_16(a,b) vaddq_s16(a,b)
   #define vec_sub_16(a,b) vsubq_s16(a,b)
-  static constexpr IndexType kNumRegs = 16;
+  // AArch64 has 32 vector registers, leave half of them for the weight columns
+  static constexpr IndexType kNumRegs = Is64Bit ? 16 : 8;
 
   #else
   #undef VECTOR
@@ -125,7 +127,7 @@ namespace Eval::NNUE {
       UpdateAccumulator(pos, WHITE);
       UpdateAccumulator(pos, BLACK);
 
-      const auto& accumulation = pos.state()->accumulator.accumulation;
+      const auto& accumulation = pos.state()->accumulator->accumulation;
 
   #if defined(USE_AVX512)
       constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth * 2);
@@ -152,8 +154,8 @@ namespace Eval::NNUE {
       const __m64 k0x80s = _mm_set1_pi8(-128);
 
   #elif defined(USE_NEON)
-      constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-      const int8x8_t kZero = {0};
+      constexpr IndexType kNumChunks = kHalfDimensions / kSimdWidth;
+      const int8x16_t kZero = vdupq_n_s8(0);
   #endif
 
       const Color perspectives[2] = {pos.side_to_move(), ~pos.side_to_move()};
@@ -214,11 +216,12 @@ namespace Eval::NNUE {
         }
 
   #elif defined(USE_NEON)
-        const auto out = reinterpret_cast<int8x8_t*>(&output[offset]);
+        const auto out = reinterpret_cast<int8x16_t*>(&output[offset]);
+        const auto in = reinterpret_cast<const int16x8_t*>(accumulation[perspectives[p]][0]);
         for (IndexType j = 0; j < kNumChunks; ++j) {
-          int16x8_t sum = reinterpret_cast<const int16x8_t*>(
-              accumulation[perspectives[p]][0])[j];
-          out[j] = vmax_s8(vqmovn_s16(sum), kZero);
+          const int8x16_t packedbytes = vcombine_s8(
+              vqmovn_s16(in[j * 2 + 0]), vqmovn_s16(in[j * 2 + 1]));
+          out[j] = vmaxq_s8(packedbytes, kZero);
         }
 
   #else
@@ -236,6 +239,17 @@ namespace Eval::NNUE {
     }
 
    private:
+    // Cost model used by UpdateAccumulator() to choose between an incremental
+    // update and a refresh. Costs are expressed in weight columns added to or
+    // subtracted from one accumulator: an incremental update pays for every
+    // changed feature plus the store of each intermediate accumulator, while
+    // a refresh pays for every active feature plus a fixed overhead.
+    static constexpr int kRefreshCostBase   = 2;
+    static constexpr int kUpdateCostPerStore = 1;
+
+    // Maximum number of positions that can be updated in a single pass
+    static constexpr int kMaxUpdatePath = 16;
+
     void UpdateAccumulator(const Position& pos, const Color c) const {
 
   #ifdef VECTOR
@@ -244,11 +258,20 @@ namespace Eval::NNUE {
       vec_t acc[kNumRegs];
   #endif
 
-      // Look for a usable accumulator of an earlier position. We keep track
-      // of the estimated gain in terms of features to be added/subtracted.
-      StateInfo *st = pos.state(), *next = nullptr;
-      int gain = pos.count<ALL_PIECES>() - 2;
-      while (st->accumulator.state[c] == EMPTY)
+      // Gather all features to be updated. This code assumes HalfKP features
+      // only and doesn't support refresh triggers.
+      static_assert(std::is_same_v<Features::FeatureSet<Features::HalfKP<Features::Side::kFriend>>,
+                                   RawFeatures>);
+
+      // Look for a usable accumulator of an earlier position. Every position
+      // between it and the current one is recorded in path[], together with
+      // its changed features, as long as an incremental update of all of them
+      // is estimated to be cheaper than a refresh of the current accumulator.
+      StateInfo *st = pos.state(), *path[kMaxUpdatePath];
+      Features::IndexList removed[kMaxUpdatePath], added[kMaxUpdatePath];
+      int pathLen = 0;
+      int budget = kRefreshCostBase + pos.count<ALL_PIECES>() - 2;
+      while (st->accumulator->state[c] == EMPTY)
       {
         auto& dp = st->dirtyPiece;
         // The first condition tests whether an incremental update is
@@ -257,48 +280,44 @@ namespace Eval::NNUE {
               Features::CompileTimeList<Features::TriggerEvent, Features::TriggerEvent::kFriendKingMoved>>,
               "Current code assumes that only kFriendlyKingMoved refresh trigger is being used.");
         if (   dp.piece[0] == make_piece(c, KING)
-            || (gain -= dp.dirty_num + 1) < 0)
+            || pathLen == kMaxUpdatePath)
           break;
-        next = st;
+
+        Features::HalfKP<Features::Side::kFriend>::AppendChangedIndices(pos,
+            dp, c, &removed[pathLen], &added[pathLen]);
+
+        budget -= int(removed[pathLen].size() + added[pathLen].size()) + kUpdateCostPerStore;
+        if (budget < 0)
+          break;
+
+        path[pathLen++] = st;
         st = st->previous;
       }
 
-      if (st->accumulator.state[c] == COMPUTED)
+      if (st->accumulator->state[c] == COMPUTED)
       {
-        if (next == nullptr)
+        if (pathLen == 0)
           return;
 
-        // Update incrementally in two steps. First, we update the "next"
-        // accumulator. Then, we update the current accumulator (pos.state()).
+        pos.this_thread()->nnueUpdates.fetch_add(1, std::memory_order_relaxed);
+
+        // Update incrementally in one pass, walking forward from the computed
+        // accumulator: path[pathLen - 1] is updated first and the current
+        // accumulator (path[0] == pos.state()) last. The intermediate
+        // accumulators are stored as well, so that sibling nodes can reuse them.
+        for (int i = 0; i < pathLen; ++i)
+          path[i]->accumulator->state[c] = COMPUTED;
 
-        // Gather all features to be updated. This code assumes HalfKP features
-        // only and doesn't support refresh triggers.
-        static_assert(std::is_same_v<Features::FeatureSet<Features::HalfKP<Features::Side::kFriend>>,
-                                     RawFeatures>);
-        Features::IndexList removed[2], added[2];
-        Features::HalfKP<Features::Side::kFriend>::AppendChangedIndices(pos,
-            next->dirtyPiece, c, &removed[0], &added[0]);
-        for (StateInfo *st2 = pos.state(); st2 != next; st2 = st2->previous)
-          Features::HalfKP<Features::Side::kFriend>::AppendChangedIndices(pos,
-              st2->dirtyPiece, c, &removed[1], &added[1]);
-
-        // Mark the accumulators as computed.
-        next->accumulator.state[c] = COMPUTED;
-        pos.state()->accumulator.state[c] = COMPUTED;
-
-        // Now update the accumulators listed in info[], where the last element is a sentinel.
-        StateInfo *info[3] =
-          { next, next == pos.state() ? nullptr : pos.state(), nullptr };
   #ifdef VECTOR
         for (IndexType j = 0; j < kHalfDimensions / kTileHeight; ++j)
         {
           // Load accumulator
           auto accTile = reinterpret_cast<vec_t*>(
-            &st->accumulator.accumulation[c][0][j * kTileHeight]);
+            &st->accumulator->accumulation[c][0][j * kTileHeight]);
           for (IndexType k = 0; k < kNumRegs; ++k)
             acc[k] = vec_load(&accTile[k]);
 
-          for (IndexType i = 0; info[i]; ++i)
+          for (int i = pathLen - 1; i >= 0; --i)
           {
             // Difference calculation for the deactivated features
             for (const auto index : removed[i])
@@ -320,19 +339,19 @@ namespace Eval::NNUE {
 
             // Store accumulator
             accTile = reinterpret_cast<vec_t*>(
-              &info[i]->accumulator.accumulation[c][0][j * kTileHeight]);
+              &path[i]->accumulator->accumulation[c][0][j * kTileHeight]);
             for (IndexType k = 0; k < kNumRegs; ++k)
               vec_store(&accTile[k], acc[k]);
           }
         }
 
   #else
-        for (IndexType i = 0; info[i]; ++i)
+        for (int i = pathLen - 1; i >= 0; --i)
         {
-          std::memcpy(info[i]->accumulator.accumulation[c][0],
-              st->accumulator.accumulation[c][0],
+          std::memcpy(path[i]->accumulator->accumulation[c][0],
+              st->accumulator->accumulation[c][0],
               kHalfDimensions * sizeof(BiasType));
-          st = info[i];
+          st = path[i];
 
           // Difference calculation for the deactivated features
           for (const auto index : removed[i])
@@ -340,7 +359,7 @@ namespace Eval::NNUE {
             const IndexType offset = kHalfDimensions * index;
 
             for (IndexType j = 0; j < kHalfDimensions; ++j)
-              st->accumulator.accumulation[c][0][j] -= weights_[offset + j];
+              st->accumulator->accumulation[c][0][j] -= weights_[offset + j];
           }
 
           // Difference calculation for the activated features
@@ -349,7 +368,7 @@ namespace Eval::NNUE {
             const IndexType offset = kHalfDimensions * index;
 
             for (IndexType j = 0; j < kHalfDimensions; ++j)
-              st->accumulator.accumulation[c][0][j] += weights_[offset + j];
+              st->accumulator->accumulation[c][0][j] += weights_[offset + j];
           }
         }
   #endif
@@ -357,8 +376,10 @@ namespace Eval::NNUE {
       else
       {
         // Refresh the accumulator
-        auto& accumulator = pos.state()->accumulator;
-        accumulator.state[c] = COMPUTED;
+        pos.this_thread()->nnueRefreshes.fetch_add(1, std::memory_order_relaxed);
+
+        auto accumulator = pos.state()->accumulator;
+        accumulator->state[c] = COMPUTED;
         Features::IndexList active;
         Features::HalfKP<Features::Side::kFriend>::AppendActiveIndices(pos, c, &active);
 
@@ -380,13 +401,13 @@ namespace Eval::NNUE {
           }
 
           auto accTile = reinterpret_cast<vec_t*>(
-              &accumulator.accumulation[c][0][j * kTileHeight]);
+              &accumulator->accumulation[c][0][j * kTileHeight]);
           for (unsigned k = 0; k < kNumRegs; k++)
             vec_store(&accTile[k], acc[k]);
         }
 
   #else
-        std::memcpy(accumulator.accumulation[c][0], biases_,
+        std::memcpy(accumulator->accumulation[c][0], biases_,
             kHalfDimensions * sizeof(BiasType));
 
         for (const auto index : active)
@@ -394,7 +415,7 @@ namespace Eval::NNUE {
           const IndexType offset = kHalfDimensions * index;
 
           for (IndexType j = 0; j < kHalfDimensions; ++j)
-            accumulator.accumulation[c][0][j] += weights_[offset + j];
+            accumulator->accumulation[c][0][j] += weights_[offset + j];
         }
   #endif
       }
@@ -0,0 +1,298 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+#include "misc.h"
+#include "packed.h"
+#include "uci.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#  define NOMINMAX // Disable macros min() and max()
+#endif
+#include <windows.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// same_file() tells whether two names are those of the same file, which
+// convert() cannot read while it is writing it.
+
+bool same_file(const string& a, const string& b) {
+
+#ifndef _WIN32
+  struct stat sa, sb;
+
+  return   !stat(a.c_str(), &sa) && !stat(b.c_str(), &sb)
+        && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+#else
+  return a == b;
+#endif
+}
+
+} // namespace
+
+namespace Packed {
+
+/// Reader::Reader() maps the file, or reads it all if it cannot be mapped. A
+/// trailing partial record is ignored.
+
+Reader::Reader(const string& fileName) {
+
+  size_t length = 0;
+
+#ifndef _WIN32
+  struct stat statbuf;
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+
+  if (fd != -1 && !fstat(fd, &statbuf) && S_ISREG(statbuf.st_mode) && statbuf.st_size > 0)
+  {
+      void* base = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+      if (base != MAP_FAILED)
+      {
+#if defined(MADV_SEQUENTIAL)
+          madvise(base, statbuf.st_size, MADV_SEQUENTIAL);
+#endif
+          baseAddress = base;
+          mapping = length = statbuf.st_size;
+      }
+  }
+
+  if (fd != -1)
+      ::close(fd);
+#else
+  HANDLE fd = CreateFile(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                         OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+  if (fd != INVALID_HANDLE_VALUE)
+  {
+      DWORD size_high;
+      DWORD size_low = GetFileSize(fd, &size_high);
+      HANDLE mmap = size_low || size_high ? CreateFileMapping(fd, nullptr, PAGE_READONLY,
+                                                              size_high, size_low, nullptr)
+                                          : nullptr;
+      CloseHandle(fd);
+
+      if (mmap && (baseAddress = MapViewOfFile(mmap, FILE_MAP_READ, 0, 0, 0)) != nullptr)
+      {
+          mapping = (uint64_t)mmap;
+          length = (uint64_t(size_high) << 32) | size_low;
+      }
+      else if (mmap)
+          CloseHandle(mmap);
+  }
+#endif
+
+  if (baseAddress)
+      records = static_cast<const Record*>(baseAddress);
+  else
+  {
+      ifstream file(fileName, ios::binary);
+
+      if (!file.is_open())
+          return;
+
+      string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+      length = data.size();
+      copy.resize(length / sizeof(Record));
+      data.copy(reinterpret_cast<char*>(copy.data()), copy.size() * sizeof(Record));
+      records = copy.data();
+  }
+
+  if (length % sizeof(Record))
+      cerr << "Ignoring the last " << length % sizeof(Record)
+           << " bytes of " << fileName << ", not a whole record" << endl;
+
+  count = length / sizeof(Record);
+  open = true;
+}
+
+
+/// Reader::~Reader() unmaps the file, if mapped
+
+Reader::~Reader() {
+
+  if (!baseAddress)
+      return;
+
+#ifndef _WIN32
+  munmap(baseAddress, mapping);
+#else
+  UnmapViewOfFile(baseAddress);
+  CloseHandle((HANDLE)mapping);
+#endif
+}
+
+
+/// Writer::Writer() opens the file, truncated unless appending to it
+
+Writer::Writer(const string& fileName, bool append)
+  : file(fileName, ios::binary | (append ? ios::app : ios::trunc)),
+    buffer(new Record[BufferSize]) {}
+
+
+/// Writer::flush() writes the records of the buffer to the file
+
+void Writer::flush() {
+
+  if (count && file.is_open())
+      file.write(reinterpret_cast<const char*>(buffer.get()), count * sizeof(Record));
+
+  count = 0;
+  file.flush();
+}
+
+
+/// record() returns the record of a position, with nothing known about it yet
+
+Record record(const Position& pos) {
+
+  return { pos.pack(), int16_t(VALUE_NONE), uint16_t(MOVE_NONE), 0, RESULT_NONE, 0 };
+}
+
+
+/// is_packed() tells a packed file from a text one, by its ".bin" extension
+
+bool is_packed(const string& fileName) {
+
+  return fileName.size() > 4 && fileName.compare(fileName.size() - 4, 4, ".bin") == 0;
+}
+
+
+/// convert() converts a file of positions, either packed or FEN and EPD lines,
+/// to the other format or to the same one. The text files have a FEN string per
+/// line, with the move, score and depth of the records, if any, as the EPD 'pm',
+/// 'ce' or 'dm' and 'acd' operations. The EPD operations of the text files read
+/// are ignored, and so are the results of the games of the packed files read.
+/// The records which are not valid positions are skipped.
+
+bool convert(const string& from, const string& to, bool chess960) {
+
+  // The output is truncated before the input is read
+  if (same_file(from, to))
+  {
+      sync_cout << "Cannot convert " << from << " to itself" << sync_endl;
+      return false;
+  }
+
+  bool toPacked = is_packed(to);
+  Writer packed(toPacked ? to : string());
+  ofstream text(toPacked ? string() : to);
+  uint64_t count = 0, skipped = 0;
+  StateInfo si;
+  Position pos;
+  char fen[MAX_FEN_LENGTH];
+
+  if ((toPacked && !packed.is_open()) || (!toPacked && !text.is_open()))
+  {
+      sync_cout << "Unable to open file " << to << sync_endl;
+      return false;
+  }
+
+  if (is_packed(from))
+  {
+      Reader in(from);
+
+      if (!in.is_open())
+      {
+          sync_cout << "Unable to open file " << from << sync_endl;
+          return false;
+      }
+
+      for (const Record& r : in)
+      {
+          if (!pos.unpack(r.pos, &si, nullptr))
+          {
+              ++skipped;
+              continue;
+          }
+
+          ++count;
+
+          if (toPacked)
+          {
+              packed.write(r);
+              continue;
+          }
+
+          text.write(fen, pos.fen(fen) - fen);
+
+          if (r.move != MOVE_NONE)
+              text << " pm " << UCI::move(Move(r.move), pos.is_chess960()) << ";";
+
+          if (r.score != VALUE_NONE)
+          {
+              string scoreType, score;
+              istringstream(UCI::value(Value(r.score))) >> scoreType >> score;
+              text << (scoreType == "cp" ? " ce " : " dm ") << score << ";";
+          }
+
+          if (r.depth)
+              text << " acd " << int(r.depth) << ";";
+
+          text << '\n';
+      }
+  }
+  else
+  {
+      ifstream in(from);
+      string line;
+
+      if (!in.is_open())
+      {
+          sync_cout << "Unable to open file " << from << sync_endl;
+          return false;
+      }
+
+      while (getline(in, line))
+      {
+          if (line.find_first_not_of(" \t\r") == string::npos || line[0] == '#')
+              continue;
+
+          pos.set(line, chess960, &si, nullptr);
+
+          if (toPacked)
+              packed.write(record(pos));
+          else
+              text.write(fen, pos.fen(fen) - fen) << '\n';
+
+          ++count;
+      }
+  }
+
+  cerr << "Converted " << count << " positions from " << from << " to " << to << endl;
+
+  if (skipped)
+      cerr << "Skipped " << skipped << " records of " << from << ", not valid positions" << endl;
+
+  return true;
+}
+
+} // namespace Packed
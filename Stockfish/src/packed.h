@@ -0,0 +1,112 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PACKED_H_INCLUDED
+#define PACKED_H_INCLUDED
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "position.h"
+
+namespace Packed {
+
+constexpr int8_t RESULT_NONE = -128;
+
+/// Record is the unit of the packed files, a packed position and what is known
+/// about it. A saved game is the sequence of the records of its positions with
+/// the moves played, and a batch analysis writes the score, best move and depth
+/// of its searches, e.g. as training data. The files are the records as they
+/// are in memory, 40 bytes each in little-endian order, without any header, so
+/// that they can be mapped, split and concatenated as they are.
+
+struct Record {
+  PackedPosition pos;
+  int16_t  score;   // From the side to move, VALUE_NONE if unknown
+  uint16_t move;    // Move played or best move, MOVE_NONE if unknown
+  uint8_t  depth;   // Depth of the search of the score, zero if none
+  int8_t   result;  // Of the game, 1, 0 or -1 for the side to move, or RESULT_NONE
+  uint16_t padding;
+};
+
+static_assert(sizeof(Record) == 40, "Records are read and written as they are in memory");
+
+/// Reader gives the records of a packed file in place, from a memory mapping of
+/// the file, or from a copy of it where it cannot be mapped, e.g. from a pipe.
+
+class Reader {
+
+public:
+  explicit Reader(const std::string& fileName);
+ ~Reader();
+  Reader(const Reader&) = delete;
+  Reader& operator=(const Reader&) = delete;
+
+  bool is_open() const { return open; }
+  const Record* begin() const { return records; }
+  const Record* end() const { return records + count; }
+  size_t size() const { return count; }
+
+private:
+  const Record* records = nullptr;
+  size_t count = 0;
+  bool open = false;
+  void* baseAddress = nullptr;
+  uint64_t mapping = 0;     // The length of the mapping, or its handle on Windows
+  std::vector<Record> copy; // If the file is not mapped
+};
+
+/// Writer writes records to a packed file through a buffer, flushed in blocks
+/// of some hundreds of kilobytes.
+
+class Writer {
+
+  static constexpr size_t BufferSize = 8192;
+
+public:
+  explicit Writer(const std::string& fileName, bool append = false);
+ ~Writer() { flush(); }
+  Writer(const Writer&) = delete;
+  Writer& operator=(const Writer&) = delete;
+
+  bool is_open() const { return file.is_open(); }
+
+  void write(const Record& r) {
+    buffer[count++] = r;
+    if (count == BufferSize)
+        flush();
+  }
+
+  void flush();
+
+private:
+  std::ofstream file;
+  std::unique_ptr<Record[]> buffer;
+  size_t count = 0;
+};
+
+Record record(const Position& pos);
+bool is_packed(const std::string& fileName);
+bool convert(const std::string& from, const std::string& to, bool chess960);
+
+} // namespace Packed
+
+#endif // #ifndef PACKED_H_INCLUDED
@@ -0,0 +1,209 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define USE_PERF_EVENTS
+#endif
+
+#include "perfcounters.h"
+
+namespace Perf {
+
+namespace {
+
+  const char* EventNames[EVENT_NB] = {
+    "cycles", "instr", "L1d-miss", "LLC-miss", "dTLB-miss", "br-miss"
+  };
+
+#if defined(USE_PERF_EVENTS)
+  constexpr uint64_t read_misses(uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  }
+
+  const std::pair<uint32_t, uint64_t> Configs[EVENT_NB] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, read_misses(PERF_COUNT_HW_CACHE_L1D) },
+    { PERF_TYPE_HW_CACHE, read_misses(PERF_COUNT_HW_CACHE_LL) },
+    { PERF_TYPE_HW_CACHE, read_misses(PERF_COUNT_HW_CACHE_DTLB) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+  };
+#endif
+
+} // namespace
+
+
+/// Group::open() opens the counters of the calling thread. The first event
+/// the kernel accepts leads the group, and the events it does not support are
+/// left out. Returns false if no event at all can be counted.
+
+bool Group::open() {
+
+  close();
+
+#if defined(USE_PERF_EVENTS)
+  for (int e = 0; e < EVENT_NB; ++e)
+  {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+
+      attr.size = sizeof(attr);
+      attr.type = Configs[e].first;
+      attr.config = Configs[e].second;
+      attr.disabled = !opened; // The leader starts and stops the whole group
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format =  PERF_FORMAT_GROUP
+                        | PERF_FORMAT_TOTAL_TIME_ENABLED
+                        | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, opened ? fds[order[0]] : -1, 0));
+
+      if (fd >= 0)
+      {
+          fds[e] = fd;
+          order[opened++] = e;
+      }
+  }
+#endif
+
+  return opened > 0;
+}
+
+
+/// Group::close() releases the counters, if any
+
+void Group::close() {
+
+#if defined(USE_PERF_EVENTS)
+  for (int fd : fds)
+      if (fd >= 0)
+          ::close(fd);
+#endif
+
+  fds.fill(-1);
+  opened = 0;
+}
+
+
+/// Group::start() resets the counters and starts counting
+
+void Group::start() {
+
+#if defined(USE_PERF_EVENTS)
+  if (opened)
+  {
+      ioctl(fds[order[0]], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(fds[order[0]], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+#endif
+}
+
+
+/// Group::stop() stops counting, the counts can then be read
+
+void Group::stop() {
+
+#if defined(USE_PERF_EVENTS)
+  if (opened)
+      ioctl(fds[order[0]], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+
+/// Group::read() returns the counts since the last start(). When the group did
+/// not get the hardware all the time, the counts are extrapolated from the time
+/// it did. A group that never got it, e.g. having more events than the CPU has
+/// counters, counts nothing.
+
+Counts Group::read() const {
+
+  Counts c;
+
+#if defined(USE_PERF_EVENTS)
+  uint64_t buf[3 + EVENT_NB]; // Number of values, time enabled, time running, values
+
+  if (!opened || ::read(fds[order[0]], buf, sizeof(buf)) < ssize_t(3 * sizeof(uint64_t)) || !buf[2])
+      return c;
+
+  double scale = double(buf[1]) / buf[2];
+
+  for (uint64_t i = 0; i < buf[0] && i < uint64_t(opened); ++i)
+  {
+      c.value[order[i]] = buf[3 + i] * scale;
+      c.valid[order[i]] = true;
+  }
+#endif
+
+  return c;
+}
+
+
+/// header() returns the first line of a table of counts, see row()
+
+std::string header(const std::string& label) {
+
+  std::stringstream ss;
+
+  ss << std::left << std::setw(22) << label << std::right;
+
+  for (const char* name : EventNames)
+      ss << std::setw(12) << name;
+
+  ss << std::setw(8) << "IPC" << "\n";
+
+  return ss.str();
+}
+
+
+/// row() returns a line of a table of counts, divided by the number of nodes,
+/// evaluations or operations they were spent on. Events that were not counted
+/// are shown as a dash, and so are all of them if there is nothing to divide by.
+
+std::string row(const std::string& label, const Counts& counts, double divisor) {
+
+  std::stringstream ss;
+
+  ss << std::left << std::setw(22) << label << std::right << std::fixed << std::setprecision(2);
+
+  for (int e = 0; e < EVENT_NB; ++e)
+      if (counts.valid[e] && divisor > 0)
+          ss << std::setw(12) << counts.value[e] / divisor;
+      else
+          ss << std::setw(12) << "-";
+
+  if (counts.valid[CYCLES] && counts.valid[INSTRUCTIONS] && counts.value[CYCLES] > 0)
+      ss << std::setw(8) << counts.value[INSTRUCTIONS] / counts.value[CYCLES];
+  else
+      ss << std::setw(8) << "-";
+
+  ss << "\n";
+
+  return ss.str();
+}
+
+} // namespace Perf
@@ -0,0 +1,86 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PERFCOUNTERS_H_INCLUDED
+#define PERFCOUNTERS_H_INCLUDED
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace Perf {
+
+/// The hardware events we count, in user space only. They are read through
+/// perf_event_open() on Linux, elsewhere none of them is available.
+
+enum Event {
+  CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, DTLB_MISSES, BRANCH_MISSES, EVENT_NB
+};
+
+/// Counts is a reading of the events, scaled up when the kernel had to share
+/// the hardware counters with other users. Events not supported by the CPU,
+/// or not allowed by the kernel, are not valid.
+
+struct Counts {
+
+  Counts& operator+=(const Counts& c) {
+    for (int e = 0; e < EVENT_NB; ++e)
+        value[e] += c.value[e], valid[e] = valid[e] || c.valid[e];
+    return *this;
+  }
+
+  bool any() const {
+    for (bool v : valid)
+        if (v)
+            return true;
+    return false;
+  }
+
+  std::array<double, EVENT_NB> value = {};
+  std::array<bool, EVENT_NB> valid = {};
+};
+
+/// Group is a group of counters of the thread that opened it, scheduled on the
+/// hardware all together so that their ratios are meaningful.
+
+class Group {
+
+  std::array<int, EVENT_NB> fds;
+  std::array<int, EVENT_NB> order; // Event of each value read, in group order
+  int opened = 0;
+
+public:
+  Group() { fds.fill(-1); }
+ ~Group() { close(); }
+  Group(const Group&) = delete;
+  Group& operator=(const Group&) = delete;
+
+  bool open();
+  void close();
+  bool is_open() const { return opened > 0; }
+  void start();
+  void stop();
+  Counts read() const;
+};
+
+std::string header(const std::string& label);
+std::string row(const std::string& label, const Counts& counts, double divisor);
+
+} // namespace Perf
+
+#endif // #ifndef PERFCOUNTERS_H_INCLUDED
@@ -18,15 +18,18 @@
 
 #include <algorithm>
 #include <cassert>
+#include <charconv>
 #include <cstddef> // For offsetof()
 #include <cstring> // For std::memset, std::memcmp
 #include <iomanip>
 #include <sstream>
 
 #include "bitboard.h"
+#include "engine.h"
 #include "misc.h"
 #include "movegen.h"
 #include "position.h"
+#include "profiler.h"
 #include "thread.h"
 #include "tt.h"
 #include "uci.h"
@@ -48,6 +51,82 @@ const string PieceToChar(" PNBRQK  pnbrqk");
 
 constexpr Piece Pieces[] = { W_PAWN, W_KNIGHT, W_BISHOP, W_ROOK, W_QUEEN, W_KING,
                              B_PAWN, B_KNIGHT, B_BISHOP, B_ROOK, B_QUEEN, B_KING };
+
+// Huffman codes of the pieces of a packed position, read from the lowest bit,
+// by piece type. An empty square is a single zero bit, and a piece is followed
+// by its color bit. The kings are apart.
+constexpr struct { unsigned code; int bits; } HuffmanCodes[KING] = {
+  { 0b0, 1 }, { 0b01, 2 }, { 0b0011, 4 }, { 0b0111, 4 }, { 0b1011, 4 }, { 0b1111, 4 }
+};
+
+// BitWriter and BitReader write and read the bits of a packed position, from
+// the lowest bit of its first byte on, through 64 bits words.
+
+struct BitWriter {
+
+  void write(unsigned value, int bits) {
+    int i = cursor / 64, offset = cursor % 64;
+    words[i] |= uint64_t(value) << offset;
+    if (offset + bits > 64)
+        words[i + 1] |= uint64_t(value) >> (64 - offset);
+    cursor += bits;
+  }
+
+  PackedPosition packed() const {
+    PackedPosition p;
+    for (int i = 0; i < 32; ++i)
+        p.data[i] = uint8_t(words[i / 8] >> (8 * (i % 8)));
+    return p;
+  }
+
+  uint64_t words[4] = {};
+  int cursor = 0;
+};
+
+struct BitReader {
+
+  explicit BitReader(const PackedPosition& p) {
+    for (int i = 0; i < 32; ++i)
+        words[i / 8] |= uint64_t(p.data[i]) << (8 * (i % 8));
+  }
+
+  // Reads zeros past the last bit, as a corrupt position may go on reading
+  unsigned read(int bits) {
+    int i = cursor / 64, offset = cursor % 64;
+    cursor += bits;
+    if (i >= 4)
+        return 0;
+    uint64_t value = words[i] >> offset;
+    if (offset + bits > 64 && i < 3)
+        value |= words[i + 1] << (64 - offset);
+    return unsigned(value & ((1ULL << bits) - 1));
+  }
+
+  bool overrun() const { return cursor > 256; }
+
+  uint64_t words[4] = {};
+  int cursor = 0;
+};
+
+// read_int() reads an integer after the blanks, as operator>>() does, and sets
+// 'n' to zero if there is none.
+
+bool read_int(const char*& p, const char* end, int& n) {
+
+  while (p < end && isspace((unsigned char)*p))
+      ++p;
+
+  auto [ptr, ec] = std::from_chars(p, end, n);
+  if (ec != std::errc())
+  {
+      n = 0;
+      return false;
+  }
+
+  p = ptr;
+  return true;
+}
+
 } // namespace
 
 
@@ -78,7 +157,6 @@ std::ostream& operator<<(std::ostream& os, const Position& pos) {
       && !pos.can_castle(ANY_CASTLING))
   {
       StateInfo st;
-      ASSERT_ALIGNED(&st, Eval::NNUE::kCacheLineSize);
 
       Position p;
       p.set(pos.fen(), pos.is_chess960(), &st, pos.this_thread());
@@ -153,9 +231,11 @@ void Position::init() {
 
 /// Position::set() initializes the position object with the given FEN string.
 /// This function is not very robust - make sure that input FENs are correct,
-/// this is assumed to be the responsibility of the GUI.
+/// this is assumed to be the responsibility of the GUI. The string is scanned
+/// in place, without any memory allocated, and anything after the fullmove
+/// number is ignored, e.g. the operations of an EPD record.
 
-Position& Position::set(const string& fenStr, bool isChess960, StateInfo* si, Thread* th) {
+Position& Position::set(std::string_view fenStr, bool isChess960, StateInfo* si, Thread* th) {
 /*
    A FEN string defines a particular position using only the ASCII character set.
 
@@ -191,19 +271,18 @@ Position& Position::set(const string& fenStr, bool isChess960, StateInfo* si, Th
       incremented after Black's move.
 */
 
-  unsigned char col, row, token;
+  const char* p = fenStr.data();
+  const char* end = p + fenStr.size();
+  unsigned char col, row, token = ' ';
   size_t idx;
   Square sq = SQ_A8;
-  std::istringstream ss(fenStr);
 
   std::memset(this, 0, sizeof(Position));
   std::memset(si, 0, sizeof(StateInfo));
   st = si;
 
-  ss >> std::noskipws;
-
   // 1. Piece placement
-  while ((ss >> token) && !isspace(token))
+  while (p < end && !isspace(token = *p++))
   {
       if (isdigit(token))
           sq += (token - '0') * EAST; // Advance the given number of files
@@ -218,16 +297,18 @@ Position& Position::set(const string& fenStr, bool isChess960, StateInfo* si, Th
   }
 
   // 2. Active color
-  ss >> token;
+  if (p < end)
+      token = *p++;
   sideToMove = (token == 'w' ? WHITE : BLACK);
-  ss >> token;
+  if (p < end)
+      ++p;
 
   // 3. Castling availability. Compatible with 3 standards: Normal FEN standard,
   // Shredder-FEN that uses the letters of the columns on which the rooks began
   // the game instead of KQkq and also X-FEN standard that, in case of Chess960,
   // if an inner rook is associated with the castling right, the castling tag is
   // replaced by the file letter of the involved rook, as for the Shredder-FEN.
-  while ((ss >> token) && !isspace(token))
+  while (p < end && !isspace(token = *p++))
   {
       Square rsq;
       Color c = islower(token) ? BLACK : WHITE;
@@ -254,39 +335,15 @@ Position& Position::set(const string& fenStr, bool isChess960, StateInfo* si, Th
 
   // 4. En passant square.
   // Ignore if square is invalid or not on side to move relative rank 6.
-  bool enpassant = false;
-
-  if (   ((ss >> col) && (col >= 'a' && col <= 'h'))
-      && ((ss >> row) && (row == (sideToMove == WHITE ? '6' : '3'))))
-  {
-      st->epSquare = make_square(File(col - 'a'), Rank(row - '1'));
-
-      // En passant square will be considered only if
-      // a) side to move have a pawn threatening epSquare
-      // b) there is an enemy pawn in front of epSquare
-      // c) there is no piece on epSquare or behind epSquare
-      // d) enemy pawn didn't block a check of its own color by moving forward
-      enpassant = pawn_attacks_bb(~sideToMove, st->epSquare) & pieces(sideToMove, PAWN)
-               && (pieces(~sideToMove, PAWN) & (st->epSquare + pawn_push(~sideToMove)))
-               && !(pieces() & (st->epSquare | (st->epSquare + pawn_push(sideToMove))))
-               && (   file_of(square<KING>(sideToMove)) == file_of(st->epSquare)
-                   || !(blockers_for_king(sideToMove) & (st->epSquare + pawn_push(~sideToMove))));
-  }
-
-  // It's necessary for st->previous to be intialized in this way because legality check relies on its existence
-  if (enpassant) {
-      st->previous = new StateInfo();
-      remove_piece(st->epSquare - pawn_push(sideToMove));
-      st->previous->checkersBB = attackers_to(square<KING>(~sideToMove)) & pieces(sideToMove);
-      st->previous->blockersForKing[WHITE] = slider_blockers(pieces(BLACK), square<KING>(WHITE), st->previous->pinners[BLACK]);
-      st->previous->blockersForKing[BLACK] = slider_blockers(pieces(WHITE), square<KING>(BLACK), st->previous->pinners[WHITE]);
-      put_piece(make_piece(~sideToMove, PAWN), st->epSquare - pawn_push(sideToMove));
-  }
+  if (   (p < end && (col = *p++) >= 'a' && col <= 'h')
+      && (p < end && (row = *p++) == (sideToMove == WHITE ? '6' : '3')))
+      set_en_passant(make_square(File(col - 'a'), Rank(row - '1')));
   else
       st->epSquare = SQ_NONE;
 
   // 5-6. Halfmove clock and fullmove number
-  ss >> std::skipws >> st->rule50 >> gamePly;
+  if (read_int(p, end, st->rule50))
+      read_int(p, end, gamePly);
 
   // Convert from fullmove starting from 1 to gamePly starting from 0,
   // handle also common incorrect FEN with fullmove = 0.
@@ -294,8 +351,6 @@ Position& Position::set(const string& fenStr, bool isChess960, StateInfo* si, Th
 
   chess960 = isChess960;
   thisThread = th;
-  st->accumulator.state[WHITE] = Eval::NNUE::INIT;
-  st->accumulator.state[BLACK] = Eval::NNUE::INIT;
 
   assert(pos_is_ok());
 
@@ -324,6 +379,40 @@ void Position::set_castling_right(Color c, Square rfrom) {
 }
 
 
+/// Position::set_en_passant() sets the en passant square of a position being
+/// set up, if an en passant capture is possible there. The legality of the
+/// capture is then tested against the state before the double push, which is
+/// not in any state list and thus kept by the position itself, in epState.
+
+void Position::set_en_passant(Square epSquare) {
+
+  st->epSquare = epSquare;
+
+  // En passant square will be considered only if
+  // a) side to move have a pawn threatening epSquare
+  // b) there is an enemy pawn in front of epSquare
+  // c) there is no piece on epSquare or behind epSquare
+  // d) enemy pawn didn't block a check of its own color by moving forward
+  bool enpassant = pawn_attacks_bb(~sideToMove, st->epSquare) & pieces(sideToMove, PAWN)
+               && (pieces(~sideToMove, PAWN) & (st->epSquare + pawn_push(~sideToMove)))
+               && !(pieces() & (st->epSquare | (st->epSquare + pawn_push(sideToMove))))
+               && (   file_of(square<KING>(sideToMove)) == file_of(st->epSquare)
+                   || !(blockers_for_king(sideToMove) & (st->epSquare + pawn_push(~sideToMove))));
+
+  // It's necessary for st->previous to be intialized in this way because legality check relies on its existence
+  if (enpassant) {
+      st->previous = &epState;
+      remove_piece(st->epSquare - pawn_push(sideToMove));
+      st->previous->checkersBB = attackers_to(square<KING>(~sideToMove)) & pieces(sideToMove);
+      st->previous->blockersForKing[WHITE] = slider_blockers(pieces(BLACK), square<KING>(WHITE), st->previous->pinners[BLACK]);
+      st->previous->blockersForKing[BLACK] = slider_blockers(pieces(WHITE), square<KING>(BLACK), st->previous->pinners[WHITE]);
+      put_piece(make_piece(~sideToMove, PAWN), st->epSquare - pawn_push(sideToMove));
+  }
+  else
+      st->epSquare = SQ_NONE;
+}
+
+
 /// Position::set_check_info() sets king attacks to detect if a move gives check
 
 void Position::set_check_info(StateInfo* si) const {
@@ -406,13 +495,46 @@ Position& Position::set(const string& code, Color c, StateInfo* si) {
 }
 
 
+/// Position::set() is an overload to initialize the position object as a copy
+/// of another one, without the round-trip through a FEN string. The current
+/// StateInfo is copied into 'si', earlier states are shared with 'pos' and so
+/// must outlive the copy. The copy belongs to thread 'th'.
+
+Position& Position::set(const Position& pos, StateInfo* si, Thread* th) {
+
+  std::memcpy(static_cast<void*>(this), &pos, sizeof(Position));
+  *si = *pos.st;
+  st = si;
+  thisThread = th;
+
+  if (st->previous == &pos.epState) // Our own copy of it
+      st->previous = &epState;
+
+  assert(pos_is_ok());
+
+  return *this;
+}
+
+
 /// Position::fen() returns a FEN representation of the position. In case of
 /// Chess960 the Shredder-FEN notation is used. This is mainly a debugging function.
 
 const string Position::fen() const {
 
+  char buf[MAX_FEN_LENGTH];
+
+  return string(buf, fen(buf));
+}
+
+
+/// Position::fen() writes the FEN string of the position to 'buf', of at least
+/// MAX_FEN_LENGTH characters, followed by a zero. Returns the end of the string.
+/// No memory is allocated, for the tools writing many positions.
+
+char* Position::fen(char* buf) const {
+
   int emptyCnt;
-  std::ostringstream ss;
+  char* s = buf;
 
   for (Rank r = RANK_8; r >= RANK_1; --r)
   {
@@ -422,37 +544,190 @@ const string Position::fen() const {
               ++emptyCnt;
 
           if (emptyCnt)
-              ss << emptyCnt;
+              *s++ = char('0' + emptyCnt);
 
           if (f <= FILE_H)
-              ss << PieceToChar[piece_on(make_square(f, r))];
+              *s++ = PieceToChar[piece_on(make_square(f, r))];
       }
 
       if (r > RANK_1)
-          ss << '/';
+          *s++ = '/';
   }
 
-  ss << (sideToMove == WHITE ? " w " : " b ");
+  *s++ = ' ';
+  *s++ = (sideToMove == WHITE ? 'w' : 'b');
+  *s++ = ' ';
 
   if (can_castle(WHITE_OO))
-      ss << (chess960 ? char('A' + file_of(castling_rook_square(WHITE_OO ))) : 'K');
+      *s++ = (chess960 ? char('A' + file_of(castling_rook_square(WHITE_OO ))) : 'K');
 
   if (can_castle(WHITE_OOO))
-      ss << (chess960 ? char('A' + file_of(castling_rook_square(WHITE_OOO))) : 'Q');
+      *s++ = (chess960 ? char('A' + file_of(castling_rook_square(WHITE_OOO))) : 'Q');
 
   if (can_castle(BLACK_OO))
-      ss << (chess960 ? char('a' + file_of(castling_rook_square(BLACK_OO ))) : 'k');
+      *s++ = (chess960 ? char('a' + file_of(castling_rook_square(BLACK_OO ))) : 'k');
 
   if (can_castle(BLACK_OOO))
-      ss << (chess960 ? char('a' + file_of(castling_rook_square(BLACK_OOO))) : 'q');
+      *s++ = (chess960 ? char('a' + file_of(castling_rook_square(BLACK_OOO))) : 'q');
 
   if (!can_castle(ANY_CASTLING))
-      ss << '-';
+      *s++ = '-';
+
+  *s++ = ' ';
+
+  if (ep_square() == SQ_NONE)
+      *s++ = '-';
+  else
+  {
+      *s++ = char('a' + file_of(ep_square()));
+      *s++ = char('1' + rank_of(ep_square()));
+  }
+
+  *s++ = ' ';
+  s = std::to_chars(s, buf + MAX_FEN_LENGTH, st->rule50).ptr;
+  *s++ = ' ';
+  s = std::to_chars(s, buf + MAX_FEN_LENGTH, 1 + (gamePly - (sideToMove == BLACK)) / 2).ptr;
+  *s = '\0';
+
+  return s;
+}
+
+
+/// Position::pack() returns the position packed in 32 bytes. The bits, from the
+/// lowest one of the first byte on, are:
+///
+///   1  side to move
+///   1  Chess960
+///  12  squares of the white and black kings
+///      the other 62 squares from A1 to H8 with their Huffman codes: 0 for an
+///      empty square, 10 for a pawn, 11 and two bits for the other pieces,
+///      each piece followed by its color (at most 182 bits)
+///  16  for each castling right, from white short to black long, whether it
+///      is available and if so the file of its rook (4 to 16 bits)
+///   4  whether there is an en passant square and if so its file (1 or 4 bits)
+///   8  halfmove clock, up to 255
+///  16  game ply, up to 65535
+///
+/// Which is 240 bits at most, the rest being zero.
+
+PackedPosition Position::pack() const {
+
+  BitWriter out;
+
+  out.write(sideToMove, 1);
+  out.write(chess960, 1);
+  out.write(square<KING>(WHITE), 6);
+  out.write(square<KING>(BLACK), 6);
+
+  // The empty squares before each piece are skipped at once, their zero bits
+  // being already there.
+  Bitboard done = 0;
+
+  for (Bitboard b = pieces() ^ pieces(KING); b; )
+  {
+      Square s = pop_lsb(&b);
+      Piece pc = piece_on(s);
+
+      out.cursor += popcount((square_bb(s) - 1) & ~done & ~pieces(KING));
+      out.write(HuffmanCodes[type_of(pc)].code, HuffmanCodes[type_of(pc)].bits);
+      out.write(color_of(pc), 1);
+      done = square_bb(s) | (square_bb(s) - 1);
+  }
+
+  out.cursor += popcount(~done & ~pieces(KING));
+
+  for (CastlingRights cr : { WHITE_OO, WHITE_OOO, BLACK_OO, BLACK_OOO })
+  {
+      out.write(can_castle(cr), 1);
+
+      if (can_castle(cr))
+          out.write(file_of(castling_rook_square(cr)), 3);
+  }
+
+  out.write(ep_square() != SQ_NONE, 1);
+
+  if (ep_square() != SQ_NONE)
+      out.write(file_of(ep_square()), 3);
+
+  out.write(std::min(st->rule50, 255), 8);
+  out.write(std::min(gamePly, 65535), 16);
+
+  return out.packed();
+}
+
+
+/// Position::unpack() initializes the position object with a packed position,
+/// as Position::set() does with its FEN string. The Chess960 flag comes with
+/// the packed position. Returns false, leaving the position unusable, if the
+/// data is not that of a valid position, e.g. a record of a corrupt file.
+
+bool Position::unpack(const PackedPosition& packed, StateInfo* si, Thread* th) {
+
+  BitReader in(packed);
+
+  std::memset(this, 0, sizeof(Position));
+  std::memset(si, 0, sizeof(StateInfo));
+  st = si;
+
+  sideToMove = Color(in.read(1));
+  chess960 = in.read(1);
+
+  Square ksq[COLOR_NB] = { Square(in.read(6)), Square(in.read(6)) };
+
+  if (ksq[WHITE] == ksq[BLACK])
+      return false;
+
+  put_piece(W_KING, ksq[WHITE]);
+  put_piece(B_KING, ksq[BLACK]);
+
+  for (Square s = SQ_A1; s <= SQ_H8; ++s)
+      if (s != ksq[WHITE] && s != ksq[BLACK] && in.read(1))
+      {
+          PieceType pt = in.read(1) ? PieceType(KNIGHT + in.read(2)) : PAWN;
+          Color c = Color(in.read(1));
+
+          if (   (pt == PAWN && (square_bb(s) & (Rank1BB | Rank8BB)))
+              || count<ALL_PIECES>(c) == 16)
+              return false;
+
+          put_piece(make_piece(c, pt), s);
+      }
+
+  for (CastlingRights cr : { WHITE_OO, WHITE_OOO, BLACK_OO, BLACK_OOO })
+      if (in.read(1))
+      {
+          Color c = cr & WHITE_CASTLING ? WHITE : BLACK;
+          Square rsq = make_square(File(in.read(3)), relative_rank(c, RANK_1));
+
+          if (   piece_on(rsq) != make_piece(c, ROOK)
+              || rank_of(ksq[c]) != rank_of(rsq)
+              || (ksq[c] < rsq) != bool(cr & KING_SIDE))
+              return false;
+
+          set_castling_right(c, rsq);
+      }
+
+  // The side to move cannot capture the king
+  if (attackers_to(ksq[~sideToMove]) & pieces(sideToMove))
+      return false;
+
+  set_state(st);
+
+  if (in.read(1))
+      set_en_passant(make_square(File(in.read(3)), relative_rank(sideToMove, RANK_6)));
+  else
+      st->epSquare = SQ_NONE;
 
-  ss << (ep_square() == SQ_NONE ? " - " : " " + UCI::square(ep_square()) + " ")
-     << st->rule50 << " " << 1 + (gamePly - (sideToMove == BLACK)) / 2;
+  st->rule50 = int(in.read(8));
+  gamePly = int(in.read(16));
+  thisThread = th;
 
-  return ss.str();
+  if (in.overrun())
+      return false;
+
+  assert(pos_is_ok());
+
+  return true;
 }
 
 
@@ -681,6 +956,8 @@ bool Position::gives_check(Move m) const {
 
 void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
 
+  Profiler::Scope<Profiler::DO_MOVE> scope;
+
   assert(is_ok(m));
   assert(&newSt != st);
 
@@ -700,9 +977,14 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
   ++st->rule50;
   ++st->pliesFromNull;
 
-  // Used by NNUE
-  st->accumulator.state[WHITE] = Eval::NNUE::EMPTY;
-  st->accumulator.state[BLACK] = Eval::NNUE::EMPTY;
+  // Used by NNUE. The accumulator of the new state is the next one on the
+  // stack of the previous state, if any.
+  if ((st->accumulator = st->previous->accumulator) != nullptr)
+  {
+      ++st->accumulator;
+      st->accumulator->state[WHITE] = Eval::NNUE::EMPTY;
+      st->accumulator->state[BLACK] = Eval::NNUE::EMPTY;
+  }
   auto& dp = st->dirtyPiece;
   dp.dirty_num = 1;
 
@@ -992,18 +1274,24 @@ void Position::do_castling(Color us, Square from, Square& to, Square& rfrom, Squ
 
 void Position::do_null_move(StateInfo& newSt) {
 
+  Profiler::Scope<Profiler::DO_MOVE> scope;
+
   assert(!checkers());
   assert(&newSt != st);
 
-  std::memcpy(&newSt, st, offsetof(StateInfo, accumulator));
+  std::memcpy(&newSt, st, offsetof(StateInfo, previous));
 
   newSt.previous = st;
   st = &newSt;
 
   st->dirtyPiece.dirty_num = 0;
   st->dirtyPiece.piece[0] = NO_PIECE; // Avoid checks in UpdateAccumulator()
-  st->accumulator.state[WHITE] = Eval::NNUE::EMPTY;
-  st->accumulator.state[BLACK] = Eval::NNUE::EMPTY;
+  if ((st->accumulator = st->previous->accumulator) != nullptr)
+  {
+      ++st->accumulator;
+      st->accumulator->state[WHITE] = Eval::NNUE::EMPTY;
+      st->accumulator->state[BLACK] = Eval::NNUE::EMPTY;
+  }
 
   if (st->epSquare != SQ_NONE)
   {
@@ -1012,7 +1300,7 @@ void Position::do_null_move(StateInfo& newSt) {
   }
 
   st->key ^= Zobrist::side;
-  prefetch(TT.first_entry(key()));
+  prefetch(thisThread->engine.tt.first_entry(key()));
 
   ++st->rule50;
   st->pliesFromNull = 0;
@@ -1060,6 +1348,8 @@ Key Position::key_after(Move m) const {
 
 bool Position::see_ge(Move m, Value threshold) const {
 
+  Profiler::Scope<Profiler::SEE> scope;
+
   assert(is_ok(m));
 
   // Only deal with normal moves, assume others pass a simple SEE
@@ -1314,7 +1604,6 @@ bool Position::pos_is_ok() const {
               assert(0 && "pos_is_ok: Bitboards");
 
   StateInfo si = *st;
-  ASSERT_ALIGNED(&si, Eval::NNUE::kCacheLineSize);
 
   set_state(&si);
   if (std::memcmp(&si, st, sizeof(StateInfo)))
@@ -23,6 +23,7 @@
 #include <deque>
 #include <memory> // For std::unique_ptr
 #include <string>
+#include <string_view>
 
 #include "bitboard.h"
 #include "evaluate.h"
@@ -51,15 +52,33 @@ struct StateInfo {
   Key        key;
   Bitboard   checkersBB;
   Piece      capturedPiece;
+  int        repetition;
   StateInfo* previous;
+
+  // Used by NNUE. The accumulator is not stored here but in a per-thread
+  // stack indexed by ply, see Thread::accumulators. States which are not
+  // part of a search (e.g. the setup moves) have no accumulator attached.
+  Eval::NNUE::Accumulator* accumulator;
+  DirtyPiece dirtyPiece;
+
+  // Check info, see Position::set_check_info(). The fields above are those
+  // written by every move, kept together in the first cache lines.
   Bitboard   blockersForKing[COLOR_NB];
   Bitboard   pinners[COLOR_NB];
-  Bitboard   checkSquares[PIECE_TYPE_NB];
-  int        repetition;
+  Bitboard   checkSquares[KING + 1];
+};
 
-  // Used by NNUE
-  Eval::NNUE::Accumulator accumulator;
-  DirtyPiece dirtyPiece;
+
+/// The longest FEN string Position::fen() writes, with the terminating zero
+constexpr int MAX_FEN_LENGTH = 128;
+
+
+/// PackedPosition is the 32 bytes binary encoding of a position, see
+/// Position::pack(). It is meant for files of many positions, read and written
+/// without the parsing and the formatting of FEN strings.
+
+struct PackedPosition {
+  uint8_t data[32];
 };
 
 
@@ -85,9 +104,15 @@ public:
   Position& operator=(const Position&) = delete;
 
   // FEN string input/output
-  Position& set(const std::string& fenStr, bool isChess960, StateInfo* si, Thread* th);
+  Position& set(std::string_view fenStr, bool isChess960, StateInfo* si, Thread* th);
   Position& set(const std::string& code, Color c, StateInfo* si);
+  Position& set(const Position& pos, StateInfo* si, Thread* th);
   const std::string fen() const;
+  char* fen(char* buf) const;
+
+  // Binary input/output
+  PackedPosition pack() const;
+  bool unpack(const PackedPosition& packed, StateInfo* si, Thread* th);
 
   // Position representation
   Bitboard pieces(PieceType pt) const;
@@ -175,6 +200,7 @@ public:
 private:
   // Initialization helpers (used while setting up a position)
   void set_castling_right(Color c, Square rfrom);
+  void set_en_passant(Square epSquare);
   void set_state(StateInfo* si) const;
   void set_check_info(StateInfo* si) const;
 
@@ -198,6 +224,7 @@ private:
   Score psq;
   Thread* thisThread;
   StateInfo* st;
+  StateInfo epState; // The state before the move giving a set up en passant square
   bool chess960;
 };
 
@@ -0,0 +1,95 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sstream>
+
+#include "profiler.h"
+
+using namespace std;
+
+namespace Profiler {
+
+thread_local Tree<true>* ThisThread = nullptr;
+
+namespace {
+
+  const char* PhaseNames[PHASE_NB] = {
+    "search", "movegen", "eval_nnue", "eval_classical", "tt_probe", "tt_save",
+    "do_move", "tb_probe", "see"
+  };
+
+  // Reporter attaches and formats the profiles, the disabled ones have
+  // nothing to show.
+
+  template<bool Enable>
+  struct Reporter {
+    static void attach(Tree<Enable>&) {}
+    static string report(const Tree<Enable>&) {
+      return "The phase profiler is not compiled in, build with phases=yes";
+    }
+  };
+
+  template<>
+  struct Reporter<true> {
+
+    static void attach(Tree<true>& tree) {
+      ThisThread = &tree;
+    }
+
+    // One line per stack: the phases from the root, separated by semicolons,
+    // then the ticks spent in the stack itself.
+    static void fold(ostream& os, const Tree<true>& tree, int n, const string& stack) {
+
+      string s = stack.empty() ? PhaseNames[tree.nodes[n].phase]
+                               : stack + ";" + PhaseNames[tree.nodes[n].phase];
+
+      if (tree.nodes[n].ticks)
+          os << s << " " << tree.nodes[n].ticks << "\n";
+
+      for (int c : tree.nodes[n].child)
+          if (c)
+              fold(os, tree, c, s);
+    }
+
+    static string report(const Tree<true>& tree) {
+      stringstream ss;
+      fold(ss, tree, 0, "");
+      return ss.str();
+    }
+  };
+
+} // namespace
+
+
+/// attach() makes the profile the one of the calling thread, which all the
+/// scopes entered by this thread charge from now on.
+
+void attach(Profile& profile) {
+  Reporter<Enabled>::attach(profile);
+}
+
+
+/// report() formats a profile as folded stacks, one line per stack of phases
+/// with the ticks spent in it, e.g. "search;movegen;see 123456". This is the
+/// input format of flamegraph.pl and of the tools compatible with it.
+
+string report(const Profile& profile) {
+  return Reporter<Enabled>::report(profile);
+}
+
+} // namespace Profiler
@@ -0,0 +1,192 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROFILER_H_INCLUDED
+#define PROFILER_H_INCLUDED
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace Profiler {
+
+/// The profiler is compiled in with 'make phases=yes', which defines
+/// USE_PHASE_PROFILER. Otherwise the phases are tagged with the empty Scope
+/// below, which the compiler removes altogether.
+
+#ifdef USE_PHASE_PROFILER
+constexpr bool Enabled = true;
+#else
+constexpr bool Enabled = false;
+#endif
+
+enum Phase {
+  SEARCH,         // Everything outside of the phases below
+  MOVEGEN,        // MovePicker::next_move(), generation and ordering of the moves
+  EVAL_NNUE,      // Eval::NNUE::evaluate()
+  EVAL_CLASSICAL, // The classical evaluation
+  TT_PROBE,       // Transposition table probes
+  TT_SAVE,        // Transposition table saves
+  DO_MOVE,        // Position::do_move() and do_null_move()
+  TB_PROBE,       // Tablebase probes
+  SEE,            // Position::see_ge()
+  PHASE_NB
+};
+
+/// now() returns the time stamp counter of the CPU, or the steady clock in
+/// nanoseconds where there is none. Only differences of it are meaningful.
+
+inline uint64_t now() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)) || defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/// Tree is the profile of a thread. Each node is a stack of nested phases, the
+/// root being the search itself, and holds the ticks spent in that stack but not
+/// in a deeper one. The disabled profile is an empty struct.
+
+template<bool Enable>
+struct Tree {
+  void clear() {}
+  void stop() {}
+  Tree& operator+=(const Tree&) { return *this; }
+};
+
+template<>
+struct Tree<true> {
+
+  static constexpr int MaxNodes = 128, MaxDepth = 16;
+
+  struct Node {
+    std::array<uint8_t, PHASE_NB> child; // Zero if none, the root is nobody's child
+    Phase phase;
+    uint64_t ticks;
+  };
+
+  // Starts profiling afresh, at the root
+  void clear() {
+    nodes[0] = { {}, SEARCH, 0 };
+    size = 1, current = 0, depth = 0, overflow = 0;
+    last = now();
+  }
+
+  // Charges the ticks since the last event to the current stack
+  void stop() {
+    uint64_t t = now();
+    nodes[current].ticks += t - last;
+    last = t;
+  }
+
+  // A full tree or stack keeps charging the stack where it stopped growing
+  void enter(Phase p) {
+    stop();
+
+    if (depth == MaxDepth)
+    {
+        ++overflow;
+        return;
+    }
+
+    uint8_t& c = nodes[current].child[p];
+
+    if (!c && size < MaxNodes)
+        c = add(p);
+
+    stack[depth++] = current;
+    current = c ? c : current;
+  }
+
+  void leave() {
+    stop();
+
+    if (overflow)
+        --overflow;
+    else
+        current = stack[--depth];
+  }
+
+  Tree& operator+=(const Tree& t) {
+    merge(t, 0, 0);
+    return *this;
+  }
+
+  uint8_t add(Phase p) {
+    nodes[size] = { {}, p, 0 };
+    return uint8_t(size++);
+  }
+
+  void merge(const Tree& t, int from, int to) {
+    nodes[to].ticks += t.nodes[from].ticks;
+
+    for (int p = 0; p < PHASE_NB; ++p)
+        if (int c = t.nodes[from].child[p])
+        {
+            uint8_t& d = nodes[to].child[p];
+
+            if (!d && size < MaxNodes)
+                d = add(Phase(p));
+
+            merge(t, c, d ? d : to);
+        }
+  }
+
+  std::array<Node, MaxNodes> nodes = {};
+  std::array<uint8_t, MaxDepth> stack = {};
+  int size = 1, current = 0, depth = 0, overflow = 0;
+  uint64_t last = 0;
+};
+
+typedef Tree<Enabled> Profile;
+
+/// The profile of the search thread running, null in the other threads, e.g.
+/// the one running the UCI loop.
+
+extern thread_local Tree<true>* ThisThread;
+
+/// Scope charges the time from its construction to its destruction to phase P,
+/// nested in the phases of the enclosing scopes.
+
+template<Phase P, bool Enable = Enabled>
+struct Scope {
+  Scope() {} // Not trivial, so that an unused scope is no warning
+};
+
+template<Phase P>
+struct Scope<P, true> {
+  Scope() : tree(ThisThread) { if (tree) tree->enter(P); }
+ ~Scope() { if (tree) tree->leave(); }
+  Tree<true>* tree;
+};
+
+void attach(Profile& profile);
+std::string report(const Profile& profile);
+
+} // namespace Profiler
+
+#endif // #ifndef PROFILER_H_INCLUDED
@@ -23,6 +23,7 @@
 #include <iostream>
 #include <sstream>
 
+#include "engine.h"
 #include "evaluate.h"
 #include "misc.h"
 #include "movegen.h"
@@ -35,19 +36,6 @@
 #include "uci.h"
 #include "syzygy/tbprobe.h"
 
-namespace Search {
-
-  LimitsType Limits;
-}
-
-namespace Tablebases {
-
-  int Cardinality;
-  bool RootInTB;
-  bool UseRule50;
-  Depth ProbeDepth;
-}
-
 namespace TB = Tablebases;
 
 using std::string;
@@ -67,11 +55,9 @@ namespace {
     return Value(234 * (d - improving));
   }
 
-  // Reductions lookup table, initialized at startup
-  int Reductions[MAX_MOVES]; // [depth or moveNumber]
-
-  Depth reduction(bool i, Depth d, int mn) {
-    int r = Reductions[d] * Reductions[mn];
+  // Reductions lookup table of the thread pool, see Search::init()
+  Depth reduction(const int* reductions, bool i, Depth d, int mn) {
+    int r = reductions[d] * reductions[mn];
     return (r + 503) / 1024 + (!i && r > 915);
   }
 
@@ -94,7 +80,7 @@ namespace {
     explicit Skill(int l) : level(l) {}
     bool enabled() const { return level < 20; }
     bool time_to_pick(Depth depth) const { return depth == 1 + level; }
-    Move pick_best(size_t multiPV);
+    Move pick_best(const RootMoves& rootMoves, size_t multiPV);
 
     int level;
     Move best = MOVE_NONE;
@@ -110,9 +96,11 @@ namespace {
   // ThreadHolding structure keeps track of which thread left breadcrumbs at the given
   // node for potential reductions. A free node will be marked upon entering the moves
   // loop by the constructor, and unmarked upon leaving that loop by the destructor.
+  // The breadcrumbs are not left in deterministic mode, where the reductions must
+  // not depend on the timing of the other threads.
   struct ThreadHolding {
     explicit ThreadHolding(Thread* thisThread, Key posKey, int ply) {
-       location = ply < 8 ? &breadcrumbs[posKey & (breadcrumbs.size() - 1)] : nullptr;
+       location = ply < 8 && !thisThread->engine.threads.deterministic ? &breadcrumbs[posKey & (breadcrumbs.size() - 1)] : nullptr;
        otherThread = false;
        owning = false;
        if (location)
@@ -143,6 +131,10 @@ namespace {
     bool otherThread, owning;
   };
 
+  // In ABDADA mode the moves of the nodes at least this deep are deferred when
+  // another thread is searching their position, see ThreadPool::being_searched()
+  constexpr Depth AbdadaDepth = 3;
+
   template <NodeType NT>
   Value search(Position& pos, Stack* ss, Value alpha, Value beta, Depth depth, bool cutNode);
 
@@ -157,56 +149,171 @@ namespace {
   void update_all_stats(const Position& pos, Stack* ss, Move bestMove, Value bestValue, Value beta, Square prevSq,
                         Move* quietsSearched, int quietCount, Move* capturesSearched, int captureCount, Depth depth);
 
+  // probe_tt() looks up a position in the transposition table, through the
+  // buffer of the thread in deterministic mode.
+  TTEntry* probe_tt(Thread* th, Key key, bool& found) {
+    return th->engine.threads.deterministic ? th->ttBuffer.probe(th->engine.tt, key, found)
+                                            : th->engine.tt.probe(key, found);
+  }
+
+  // reprobe_tt() returns the entry of a node again after searching some of its
+  // children. In deterministic mode an epoch may have ended meanwhile and the
+  // buffer of the thread been emptied and reused, so the entry is looked up
+  // again if so.
+  TTEntry* reprobe_tt(Thread* th, TTEntry* tte, Key key, uint64_t& ttEpoch) {
+
+    if (!th->engine.threads.deterministic || ttEpoch == th->ttBuffer.epoch())
+        return tte;
+
+    bool found;
+    ttEpoch = th->ttBuffer.epoch();
+    return th->ttBuffer.probe(th->engine.tt, key, found);
+  }
+
   // perft() is our utility to verify move generation. All the leaf nodes up
   // to the given depth are generated and counted, and the sum is returned.
-  template<bool Root>
-  uint64_t perft(Position& pos, Depth depth) {
+  // Moves at depth 1 are counted in bulk, without being made, and the counts
+  // of the subtrees are stored in the perft table.
+
+  uint64_t perft(Position& pos, Depth depth, PerftTable& table) {
+
+    if (depth <= 1)
+        return depth == 1 ? MoveList<LEGAL>(pos).size() : 1;
 
     StateInfo st;
-    ASSERT_ALIGNED(&st, Eval::NNUE::kCacheLineSize);
+    uint64_t nodes = 0;
 
-    uint64_t cnt, nodes = 0;
-    const bool leaf = (depth == 2);
+    if (table.probe(pos.key(), depth, nodes))
+        return nodes;
 
     for (const auto& m : MoveList<LEGAL>(pos))
     {
-        if (Root && depth <= 1)
-            cnt = 1, nodes++;
-        else
-        {
-            pos.do_move(m, st);
-            cnt = leaf ? MoveList<LEGAL>(pos).size() : perft<false>(pos, depth - 1);
-            nodes += cnt;
-            pos.undo_move(m);
-        }
-        if (Root)
-            sync_cout << UCI::move(m, pos.is_chess960()) << ": " << cnt << sync_endl;
+        pos.do_move(m, st);
+        nodes += perft(pos, depth - 1, table);
+        pos.undo_move(m);
     }
+
+    table.save(pos.key(), depth, nodes);
     return nodes;
   }
 
 } // namespace
 
 
-/// Search::init() is called at startup to initialize various lookup tables
+/// Search::Perft is the work of a perft shared by the threads. The tree is split
+/// at the second ply, which gives enough subtrees to keep all the threads busy,
+/// and the threads pick the subtrees one at a time from a shared counter.
 
-void Search::init() {
+struct Search::Perft {
 
-  for (int i = 1; i < MAX_MOVES; ++i)
-      Reductions[i] = int((21.3 + 2 * std::log(Threads.size())) * std::log(i + 0.25 * std::log(i)));
-}
+  struct Subtree {
+    size_t rootIdx;
+    Move moves[2];
+    uint64_t nodes;
+  };
+
+  Perft(Depth d, PerftTable& t) : table(t), depth(d), next(0) {}
+
+  // Each subtree is counted by exactly one thread, so no locking is needed
+  void count_subtrees(Position& pos) {
+
+    StateInfo st[2];
+
+    for (size_t i; (i = next++) < subtrees.size(); )
+    {
+        Subtree& t = subtrees[i];
+        pos.do_move(t.moves[0], st[0]);
+        pos.do_move(t.moves[1], st[1]);
+        t.nodes = perft(pos, depth - 2, table);
+        pos.undo_move(t.moves[1]);
+        pos.undo_move(t.moves[0]);
+    }
+  }
+
+  PerftTable& table;
+  Depth depth;
+  std::vector<Subtree> subtrees;
+  std::atomic<size_t> next;
+};
 
+namespace {
+
+  // perft_divide() runs a perft with all the threads of the engine and prints
+  // the count of each root move, then the total, which is returned.
+
+  uint64_t perft_divide(Position& pos, Depth depth, Engine& engine) {
+
+    ThreadPool& threads = engine.threads;
+    TimePoint elapsed = now();
+    std::vector<Move> rootMoves;
+    std::vector<uint64_t> counts;
+    StateInfo st;
 
-/// Search::clear() resets search state to its initial value
+    for (const auto& m : MoveList<LEGAL>(pos))
+        rootMoves.push_back(m);
 
-void Search::clear() {
+    counts.resize(rootMoves.size(), 0);
 
-  Threads.main()->wait_for_search_finished();
+    if (depth <= 2)
+        for (size_t i = 0; i < rootMoves.size(); ++i)
+        {
+            pos.do_move(rootMoves[i], st);
+            counts[i] = depth == 2 ? MoveList<LEGAL>(pos).size() : 1;
+            pos.undo_move(rootMoves[i]);
+        }
+    else
+    {
+        threads.perftTable.resize(engine.tt_size());
+        Perft perft(depth, threads.perftTable);
 
-  Time.availableNodes = 0;
-  TT.clear();
-  Threads.clear();
-  Tablebases::init(Options["SyzygyPath"]); // Free mapped files
+        for (size_t i = 0; i < rootMoves.size(); ++i)
+        {
+            pos.do_move(rootMoves[i], st);
+            for (const auto& m : MoveList<LEGAL>(pos))
+                perft.subtrees.push_back({ i, { rootMoves[i], m }, 0 });
+            pos.undo_move(rootMoves[i]);
+        }
+
+        threads.perft = &perft;
+        threads.start_searching(); // start non-main threads
+        perft.count_subtrees(pos);
+        threads.wait_for_search_finished();
+        threads.perft = nullptr;
+
+        for (Thread* th : threads)
+            th->nodes = 0; // Only the leaves are reported as nodes, by our caller
+
+        for (const auto& t : perft.subtrees)
+            counts[t.rootIdx] += t.nodes;
+    }
+
+    uint64_t nodes = 0;
+
+    for (size_t i = 0; i < rootMoves.size(); ++i)
+    {
+        sync_cout << UCI::move(rootMoves[i], pos.is_chess960()) << ": " << counts[i] << sync_endl;
+        nodes += counts[i];
+    }
+
+    elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+    sync_cout << "\nNodes searched: " << nodes
+              << "\nTime (ms): " << elapsed
+              << "\nNodes/second: " << 1000 * nodes / elapsed << "\n" << sync_endl;
+
+    return nodes;
+  }
+
+} // namespace
+
+
+/// Search::init() initializes the lookup tables of a thread pool, which depend
+/// on its number of threads.
+
+void Search::init(ThreadPool& threads) {
+
+  for (int i = 1; i < MAX_MOVES; ++i)
+      threads.reductions[i] = int((21.3 + 2 * std::log(threads.size())) * std::log(i + 0.25 * std::log(i)));
 }
 
 
@@ -215,29 +322,32 @@ void Search::clear() {
 
 void MainThread::search() {
 
-  if (Limits.perft)
+  if (engine.limits.perft)
   {
-      nodes = perft<true>(rootPos, Limits.perft);
-      sync_cout << "\nNodes searched: " << nodes << "\n" << sync_endl;
+      nodes = perft_divide(rootPos, engine.limits.perft, engine);
+      engine.telemetry.stop();
       return;
   }
 
   Color us = rootPos.side_to_move();
-  Time.init(Limits, us, rootPos.game_ply());
-  TT.new_search();
+  engine.time.init(engine.limits, us, rootPos.game_ply());
+  if (engine.owns_tt())
+      engine.tt.new_search();
 
-  Eval::NNUE::verify();
+  if (!engine.limits.silent)
+      Eval::NNUE::verify(net);
 
   if (rootMoves.empty())
   {
       rootMoves.emplace_back(MOVE_NONE);
-      sync_cout << "info depth 0 score "
-                << UCI::value(rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW)
-                << sync_endl;
+      if (!engine.limits.silent)
+          sync_cout << "info depth 0 score "
+                    << UCI::value(rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW)
+                    << sync_endl;
   }
   else
   {
-      Threads.start_searching(); // start non-main threads
+      engine.threads.start_searching(); // start non-main threads
       Thread::search();          // main thread start searching
   }
 
@@ -247,33 +357,79 @@ void MainThread::search() {
   // GUI sends a "stop" or "ponderhit" command. We therefore simply wait here
   // until the GUI sends one of those commands.
 
-  while (!Threads.stop && (ponder || Limits.infinite))
+  // In parallel MultiPV mode, a search to a fixed depth is over when all the PV
+  // lines have reached that depth, whichever group of threads searches them.
+  while (!engine.threads.stop && engine.threads.multipv_pending())
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  while (!engine.threads.stop && (ponder || engine.limits.infinite))
   {} // Busy wait for a stop or a ponder reset
 
   // Stop the threads if not already stopped (also raise the stop if
   // "ponderhit" just reset Threads.ponder).
-  Threads.stop = true;
+  engine.threads.stop = true;
 
   // Wait until all threads have finished
-  Threads.wait_for_search_finished();
+  engine.threads.wait_for_search_finished();
+  engine.telemetry.stop();
+
+  profile.stop(); // Charge the main thread up to now, the helpers are done
+
+  for (Thread* th : engine.threads)
+  {
+      engine.threads.searchStats += th->searchStats;
+      engine.threads.profile += th->profile;
+  }
 
   // When playing in 'nodes as time' mode, subtract the searched nodes from
   // the available ones before exiting.
-  if (Limits.npmsec)
-      Time.availableNodes += Limits.inc[us] - Threads.nodes_searched();
+  if (engine.limits.npmsec)
+      engine.time.availableNodes += engine.limits.inc[us] - engine.threads.nodes_searched();
+
+  bestThread = this;
 
-  Thread* bestThread = this;
+  // Take the best of the PV lines searched by all the groups of threads
+  if (engine.threads.pvGroups > 1)
+  {
+      std::vector<Depth> depths;
+      rootMoves = engine.threads.multipv_lines(rootMoves, depths);
+  }
 
   if (   int(Options["MultiPV"]) == 1
-      && !Limits.depth
+      && !engine.limits.depth
       && !(Skill(Options["Skill Level"]).enabled() || int(Options["UCI_LimitStrength"]))
       && rootMoves[0].pv[0] != MOVE_NONE)
-      bestThread = Threads.get_best_thread();
+      bestThread = engine.threads.get_best_thread();
 
   bestPreviousScore = bestThread->rootMoves[0].score;
 
-  // Send again PV info if we have a new best thread
-  if (bestThread != this)
+  // Remember the PV and the positions along it, for the next search to start
+  // from if its root is one of them. The moves are not counted as searched.
+  uint64_t searchedNodes = nodes;
+  std::vector<StateInfo> states(bestThread->rootMoves[0].pv.size());
+
+  lastPv.clear();
+  lastPvKeys.assign(1, rootPos.key());
+
+  for (Move m : bestThread->rootMoves[0].pv)
+      if (m != MOVE_NONE)
+      {
+          rootPos.do_move(m, states[lastPv.size()]);
+          lastPv.push_back(m);
+          lastPvKeys.push_back(rootPos.key());
+      }
+
+  for (auto m = lastPv.rbegin(); m != lastPv.rend(); ++m)
+      rootPos.undo_move(*m);
+
+  nodes = searchedNodes;
+
+  if (engine.limits.silent)
+      return;
+
+  // Send again PV info if we have a new best thread, or new lines from the
+  // other groups of threads.
+  if (bestThread != this || engine.threads.pvGroups > 1)
       sync_cout << UCI::pv(bestThread->rootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
 
   sync_cout << "\nComputer Best Move: " << UCI::move(bestThread->rootMoves[0].pv[0], rootPos.is_chess960());
@@ -281,7 +437,52 @@ void MainThread::search() {
   //if (bestThread->rootMoves[0].pv.size() > 1 || bestThread->rootMoves[0].extract_ponder_from_tt(rootPos))
   //    std::cout << " ponder " << UCI::move(bestThread->rootMoves[0].pv[1], rootPos.is_chess960());
 
-  std::cout << sync_endl;
+  sync_stream() << sync_endl;
+}
+
+
+/// MainThread::seed_from_last_search() is called before a search, once the root
+/// moves are generated. If the root is a position along the PV of the last
+/// search, e.g. after the predicted reply to the move played, the move the PV
+/// goes on with is put first, with the rest of the PV and the score of the last
+/// search. The first aspiration window is then centred on that score, and the
+/// iterative deepening starts at the depth of the root in the TT. With MultiPV
+/// the other lines would start that deep without a score to centre their window
+/// on, so the search is not seeded.
+
+void MainThread::seed_from_last_search() {
+
+  ThreadPool& threads = engine.threads;
+  RootMoves& rms = threads.rootMoves;
+
+  threads.startDepth = 0;
+
+  auto key = std::find(lastPvKeys.begin(), lastPvKeys.end(), rootPos.key());
+  size_t ply = size_t(key - lastPvKeys.begin()); // PV moves played since
+
+  // With a handicap the iterative deepening must go through the low depths
+  if (   ply >= lastPv.size()
+      || int(Options["MultiPV"]) > 1
+      || abs(bestPreviousScore) >= VALUE_TB_WIN_IN_MAX_PLY
+      || Skill(Options["Skill Level"]).enabled()
+      || int(Options["UCI_LimitStrength"]))
+      return;
+
+  auto rm = std::find(rms.begin(), rms.end(), lastPv[ply]);
+
+  if (rm == rms.end() || rm->tbRank != rms[0].tbRank)
+      return;
+
+  std::rotate(rms.begin(), rm, rm + 1);
+  rms[0].pv.assign(lastPv.begin() + ply, lastPv.end());
+  rms[0].score = ply % 2 ? -bestPreviousScore : bestPreviousScore;
+
+  bool ttHit;
+  TTEntry* tte = engine.tt.probe(rootPos.key(), ttHit);
+
+  if (ttHit && tte->depth() > 1)
+      threads.startDepth = std::min(tte->depth() - 1,
+                                    engine.limits.depth ? engine.limits.depth - 1 : MAX_PLY);
 }
 
 
@@ -300,11 +501,20 @@ void Thread::search() {
   Value bestValue, alpha, beta, delta;
   Move  lastBestMove = MOVE_NONE;
   Depth lastBestMoveDepth = 0;
-  MainThread* mainThread = (this == Threads.main() ? Threads.main() : nullptr);
+  MainThread* mainThread = (this == engine.threads.main() ? engine.threads.main() : nullptr);
   double timeReduction = 1, totBestMoveChanges = 0;
   Color us = rootPos.side_to_move();
   int iterIdx = 0;
 
+  firstNodeLatency = now_us() - engine.threads.goTime;
+
+  // The helpers of a perft only count the subtrees set up by the main thread
+  if (engine.threads.perft)
+  {
+      engine.threads.perft->count_subtrees(rootPos);
+      return;
+  }
+
   std::memset(ss-7, 0, 10 * sizeof(Stack));
   for (int i = 7; i > 0; i--)
       (ss-i)->continuationHistory = &this->continuationHistory[0][0][NO_PIECE][0]; // Use as a sentinel
@@ -348,12 +558,13 @@ void Thread::search() {
       multiPV = std::max(multiPV, (size_t)4);
 
   multiPV = std::min(multiPV, rootMoves.size());
+  size_t pvGroups = engine.threads.pvGroups;
   ttHitAverage = TtHitAverageWindow * TtHitAverageResolution / 2;
 
   int ct = int(Options["Contempt"]) * PawnValueEg / 100; // From centipawns
 
   // In analysis mode, adjust contempt in accordance with user preference
-  if (Limits.infinite || Options["UCI_AnalyseMode"])
+  if (engine.limits.infinite || Options["UCI_AnalyseMode"])
       ct =  Options["Analysis Contempt"] == "Off"  ? 0
           : Options["Analysis Contempt"] == "Both" ? ct
           : Options["Analysis Contempt"] == "White" && us == BLACK ? -ct
@@ -368,9 +579,11 @@ void Thread::search() {
 
   // Iterative deepening loop until requested to stop or the target depth is reached
   while (   ++rootDepth < MAX_PLY
-         && !Threads.stop
-         && !(Limits.depth && mainThread && rootDepth > Limits.depth))
+         && !engine.threads.stop
+         && !(engine.limits.depth && mainThread && rootDepth > engine.limits.depth))
   {
+      iterationDepth.store(rootDepth, std::memory_order_relaxed);
+
       // Age out PV variability metric
       if (mainThread)
           totBestMoveChanges /= 2;
@@ -383,13 +596,22 @@ void Thread::search() {
       size_t pvFirst = 0;
       pvLast = 0;
 
-      if (!Threads.increaseDepth)
+      if (!engine.threads.increaseDepth)
          searchAgainCounter++;
 
-      // MultiPV loop. We perform a full root search for each PV line
-      for (pvIdx = 0; pvIdx < multiPV && !Threads.stop; ++pvIdx)
+      // MultiPV loop. We perform a full root search for each PV line. In parallel
+      // MultiPV mode the thread searches only the lines of its group, each time
+      // after the moves of the lines before it, as published by the other groups.
+      for (size_t line = idx % pvGroups; line < multiPV && !engine.threads.stop; line += pvGroups)
       {
-          if (pvIdx == pvLast)
+          if (pvGroups > 1)
+          {
+              pvFirst = pvIdx = engine.threads.exclude_lines(line, rootMoves);
+              for (pvLast = pvIdx + 1; pvLast < rootMoves.size(); pvLast++)
+                  if (rootMoves[pvLast].tbRank != rootMoves[pvFirst].tbRank)
+                      break;
+          }
+          else if ((pvIdx = line) == pvLast)
           {
               pvFirst = pvLast;
               for (pvLast++; pvLast < rootMoves.size(); pvLast++)
@@ -435,15 +657,16 @@ void Thread::search() {
               // If search has been stopped, we break immediately. Sorting is
               // safe because RootMoves is still valid, although it refers to
               // the previous iteration.
-              if (Threads.stop)
+              if (engine.threads.stop)
                   break;
 
               // When failing high/low give some update (without cluttering
               // the UI) before a re-search.
               if (   mainThread
+                  && !engine.limits.silent
                   && multiPV == 1
                   && (bestValue <= alpha || bestValue >= beta)
-                  && Time.elapsed() > 3000)
+                  && engine.time.elapsed() > 3000)
                   sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
 
               // In case of failing low/high increase aspiration window and
@@ -470,15 +693,23 @@ void Thread::search() {
               assert(alpha >= -VALUE_INFINITE && beta <= VALUE_INFINITE);
           }
 
-          // Sort the PV lines searched so far and update the GUI
-          std::stable_sort(rootMoves.begin() + pvFirst, rootMoves.begin() + pvIdx + 1);
+          // Sort the PV lines searched so far and update the GUI. The lines of
+          // the other groups are sorted in with them by UCI::pv().
+          if (pvGroups > 1)
+          {
+              if (!engine.threads.stop)
+                  engine.threads.publish_line(line, rootMoves[pvIdx], rootDepth);
+          }
+          else
+              std::stable_sort(rootMoves.begin() + pvFirst, rootMoves.begin() + pvIdx + 1);
 
           if (    mainThread
-              && (Threads.stop || pvIdx + 1 == multiPV || Time.elapsed() > 3000))
+              && !engine.limits.silent
+              && (engine.threads.stop || line + pvGroups >= multiPV || engine.time.elapsed() > 3000))
               sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
       }
 
-      if (!Threads.stop)
+      if (!engine.threads.stop)
           completedDepth = rootDepth;
 
       if (rootMoves[0].pv[0] != lastBestMove) {
@@ -486,22 +717,27 @@ void Thread::search() {
          lastBestMoveDepth = rootDepth;
       }
 
+      if (!engine.threads.stop)
+          iterations.push_back({ rootDepth, rootMoves[0].pv[0],
+                                 now_us() - engine.threads.goTime,
+                                 engine.threads.nodes_searched() });
+
       // Have we found a "mate in x"?
-      if (   Limits.mate
+      if (   engine.limits.mate
           && bestValue >= VALUE_MATE_IN_MAX_PLY
-          && VALUE_MATE - bestValue <= 2 * Limits.mate)
-          Threads.stop = true;
+          && VALUE_MATE - bestValue <= 2 * engine.limits.mate)
+          engine.threads.stop = true;
 
       if (!mainThread)
           continue;
 
       // If skill level is enabled and time is up, pick a sub-optimal best move
       if (skill.enabled() && skill.time_to_pick(rootDepth))
-          skill.pick_best(multiPV);
+          skill.pick_best(rootMoves, multiPV);
 
       // Do we have time for the next iteration? Can we stop searching now?
-      if (    Limits.use_time_management()
-          && !Threads.stop
+      if (    engine.limits.use_time_management()
+          && !engine.threads.stop
           && !mainThread->stopOnPonderhit)
       {
           double fallingEval = (318 + 6 * (mainThread->bestPreviousScore - bestValue)
@@ -513,14 +749,14 @@ void Thread::search() {
           double reduction = (1.47 + mainThread->previousTimeReduction) / (2.32 * timeReduction);
 
           // Use part of the gained time from a previous stable move for the current move
-          for (Thread* th : Threads)
+          for (Thread* th : engine.threads)
           {
               totBestMoveChanges += th->bestMoveChanges;
               th->bestMoveChanges = 0;
           }
-          double bestMoveInstability = 1 + 2 * totBestMoveChanges / Threads.size();
+          double bestMoveInstability = 1 + 2 * totBestMoveChanges / engine.threads.size();
 
-          double totalTime = Time.optimum() * fallingEval * reduction * bestMoveInstability;
+          double totalTime = engine.time.optimum() * fallingEval * reduction * bestMoveInstability;
 
           // Cap used time in case of a single legal move for a better viewer experience in tournaments
           // yielding correct scores and sufficiently fast moves.
@@ -528,27 +764,38 @@ void Thread::search() {
               totalTime = std::min(500.0, totalTime);
 
           // Stop the search if we have exceeded the totalTime
-          if (Time.elapsed() > totalTime)
+          if (engine.time.elapsed() > totalTime)
           {
               // If we are allowed to ponder do not stop the search now but
               // keep pondering until the GUI sends "ponderhit" or "stop".
               if (mainThread->ponder)
                   mainThread->stopOnPonderhit = true;
               else
-                  Threads.stop = true;
+                  engine.threads.stop = true;
           }
-          else if (   Threads.increaseDepth
+          else if (   engine.threads.increaseDepth
                    && !mainThread->ponder
-                   && Time.elapsed() > totalTime * 0.58)
-                   Threads.increaseDepth = false;
+                   && engine.time.elapsed() > totalTime * 0.58)
+                   engine.threads.increaseDepth = false;
           else
-                   Threads.increaseDepth = true;
+                   engine.threads.increaseDepth = true;
       }
 
       mainThread->iterValue[iterIdx] = bestValue;
       iterIdx = (iterIdx + 1) & 3;
   }
 
+  // In deterministic mode all the threads stop together at the end of an epoch,
+  // so a thread done with its search still takes part in the epochs until then.
+  if (engine.threads.deterministic)
+  {
+      if (mainThread && !mainThread->ponder && !engine.limits.infinite)
+          engine.threads.mainDone = true;
+
+      while (!engine.threads.stop)
+          sync_epoch();
+  }
+
   if (!mainThread)
       return;
 
@@ -557,7 +804,7 @@ void Thread::search() {
   // If skill level is enabled, swap best PV line with the sub-optimal one
   if (skill.enabled())
       std::swap(rootMoves[0], *std::find(rootMoves.begin(), rootMoves.end(),
-                skill.best ? skill.best : skill.pick_best(multiPV)));
+                skill.best ? skill.best : skill.pick_best(rootMoves, multiPV)));
 }
 
 
@@ -595,21 +842,24 @@ namespace {
 
     Move pv[MAX_PLY+1], capturesSearched[32], quietsSearched[64];
     StateInfo st;
-    ASSERT_ALIGNED(&st, Eval::NNUE::kCacheLineSize);
 
     TTEntry* tte;
+    uint64_t ttEpoch;
     Key posKey;
     Move ttMove, move, excludedMove, bestMove;
+    Move deferredMoves[32];
     Depth extension, newDepth;
     Value bestValue, value, ttValue, eval, maxValue, probCutBeta;
     bool formerPv, givesCheck, improving, didLMR, priorCapture;
     bool captureOrPromotion, doFullDepthSearch, moveCountPruning,
          ttCapture, singularQuietLMR;
     Piece movedPiece;
-    int moveCount, captureCount, quietCount;
+    int moveCount, captureCount, quietCount, deferredCount, deferredIdx;
+    bool abdada;
 
     // Step 1. Initialize node
     Thread* thisThread = pos.this_thread();
+    Engine& engine = thisThread->engine;
     ss->inCheck = pos.checkers();
     priorCapture = pos.captured_piece();
     Color us = pos.side_to_move();
@@ -618,9 +868,14 @@ namespace {
     maxValue = VALUE_INFINITE;
 
     // Check for the available remaining time
-    if (thisThread == Threads.main())
+    if (thisThread == engine.threads.main())
         static_cast<MainThread*>(thisThread)->check_time();
 
+    if (engine.threads.deterministic && thisThread->nodes >= thisThread->epochEnd)
+        thisThread->sync_epoch();
+
+    thisThread->searchStats.inc(SearchStats::NODES, depth);
+
     // Used to send selDepth info to GUI (selDepth counts from 1, ply from 0)
     if (PvNode && thisThread->selDepth < ss->ply + 1)
         thisThread->selDepth = ss->ply + 1;
@@ -628,7 +883,7 @@ namespace {
     if (!rootNode)
     {
         // Step 2. Check for aborted search and immediate draw
-        if (   Threads.stop.load(std::memory_order_relaxed)
+        if (   engine.threads.stop.load(std::memory_order_relaxed)
             || pos.is_draw(ss->ply)
             || ss->ply >= MAX_PLY)
             return (ss->ply >= MAX_PLY && !ss->inCheck) ? evaluate(pos)
@@ -667,7 +922,8 @@ namespace {
     // position key in case of an excluded move.
     excludedMove = ss->excludedMove;
     posKey = excludedMove == MOVE_NONE ? pos.key() : pos.key() ^ make_key(excludedMove);
-    tte = TT.probe(posKey, ss->ttHit);
+    tte = probe_tt(thisThread, posKey, ss->ttHit);
+    ttEpoch = thisThread->ttBuffer.epoch();
     ttValue = ss->ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
     ttMove =  rootNode ? thisThread->rootMoves[thisThread->pvIdx].pv[0]
             : ss->ttHit    ? tte->move() : MOVE_NONE;
@@ -720,16 +976,21 @@ namespace {
         // Partial workaround for the graph history interaction problem
         // For high rule50 counts don't produce transposition table cutoffs.
         if (pos.rule50_count() < 90)
+        {
+            thisThread->searchStats.inc(SearchStats::TT_CUTS, depth);
             return ttValue;
+        }
     }
 
     // Step 5. Tablebases probe
-    if (!rootNode && TB::Cardinality)
+    const TB::Config& tbConfig = engine.threads.tbConfig;
+
+    if (!rootNode && tbConfig.cardinality)
     {
         int piecesCount = pos.count<ALL_PIECES>();
 
-        if (    piecesCount <= TB::Cardinality
-            && (piecesCount <  TB::Cardinality || depth >= TB::ProbeDepth)
+        if (    piecesCount <= tbConfig.cardinality
+            && (piecesCount <  tbConfig.cardinality || depth >= tbConfig.probeDepth)
             &&  pos.rule50_count() == 0
             && !pos.can_castle(ANY_CASTLING))
         {
@@ -737,14 +998,14 @@ namespace {
             TB::WDLScore wdl = Tablebases::probe_wdl(pos, &err);
 
             // Force check of time on the next occasion
-            if (thisThread == Threads.main())
+            if (thisThread == engine.threads.main())
                 static_cast<MainThread*>(thisThread)->callsCnt = 0;
 
             if (err != TB::ProbeState::FAIL)
             {
                 thisThread->tbHits.fetch_add(1, std::memory_order_relaxed);
 
-                int drawScore = TB::UseRule50 ? 1 : 0;
+                int drawScore = tbConfig.useRule50 ? 1 : 0;
 
                 // use the range VALUE_MATE_IN_MAX_PLY to VALUE_TB_WIN_IN_MAX_PLY to score
                 value =  wdl < -drawScore ? VALUE_MATED_IN_MAX_PLY + ss->ply + 1
@@ -759,7 +1020,7 @@ namespace {
                 {
                     tte->save(posKey, value_to_tt(value, ss->ply), ss->ttPv, b,
                               std::min(MAX_PLY - 1, depth + 6),
-                              MOVE_NONE, VALUE_NONE);
+                              MOVE_NONE, VALUE_NONE, engine.tt.generation());
 
                     return value;
                 }
@@ -790,7 +1051,7 @@ namespace {
         // Never assume anything about values stored in TT
         ss->staticEval = eval = tte->eval();
         if (eval == VALUE_NONE)
-            ss->staticEval = eval = evaluate(pos);
+            ss->staticEval = eval = engine.evalCache.evaluate(pos);
 
         // Randomize draw evaluation
         if (eval == VALUE_DRAW)
@@ -806,12 +1067,12 @@ namespace {
         // In case of null move search use previous static eval with a different sign
         // and addition of two tempos
         if ((ss-1)->currentMove != MOVE_NULL)
-            ss->staticEval = eval = evaluate(pos);
+            ss->staticEval = eval = engine.evalCache.evaluate(pos);
         else
             ss->staticEval = eval = -(ss-1)->staticEval + 2 * Tempo;
 
         // Save static evaluation into transposition table
-        tte->save(posKey, VALUE_NONE, ss->ttPv, BOUND_NONE, DEPTH_NONE, MOVE_NONE, eval);
+        tte->save(posKey, VALUE_NONE, ss->ttPv, BOUND_NONE, DEPTH_NONE, MOVE_NONE, eval, engine.tt.generation());
     }
 
     // Use static evaluation difference to improve quiet move ordering
@@ -834,7 +1095,10 @@ namespace {
         &&  depth < 9
         &&  eval - futility_margin(depth, improving) >= beta
         &&  eval < VALUE_KNOWN_WIN) // Do not return unproven wins
+    {
+        thisThread->searchStats.inc(SearchStats::FUTILITY_PRUNED, depth);
         return eval;
+    }
 
     // Step 8. Null move search with verification search (~40 Elo)
     if (   !PvNode
@@ -857,6 +1121,8 @@ namespace {
 
         pos.do_null_move(st);
 
+        thisThread->searchStats.inc(SearchStats::NULL_MOVE_TRIED, depth);
+
         Value nullValue = -search<NonPV>(pos, ss+1, -beta, -beta+1, depth-R, !cutNode);
 
         pos.undo_null_move();
@@ -868,7 +1134,10 @@ namespace {
                 nullValue = beta;
 
             if (thisThread->nmpMinPly || (abs(beta) < VALUE_KNOWN_WIN && depth < 14))
+            {
+                thisThread->searchStats.inc(SearchStats::NULL_MOVE_CUTS, depth);
                 return nullValue;
+            }
 
             assert(!thisThread->nmpMinPly); // Recursive verification is not allowed
 
@@ -882,10 +1151,15 @@ namespace {
             thisThread->nmpMinPly = 0;
 
             if (v >= beta)
+            {
+                thisThread->searchStats.inc(SearchStats::NULL_MOVE_CUTS, depth);
                 return nullValue;
+            }
         }
     }
 
+    tte = reprobe_tt(thisThread, tte, posKey, ttEpoch); // After the null move search
+
     probCutBeta = beta + 209 - 44 * improving;
 
     // Step 9. ProbCut (~10 Elo)
@@ -948,13 +1222,15 @@ namespace {
 
                 if (value >= probCutBeta)
                 {
+                    tte = reprobe_tt(thisThread, tte, posKey, ttEpoch);
+
                     // if transposition table doesn't have equal or more deep info write probCut data into it
                     if ( !(ss->ttHit
                        && tte->depth() >= depth - 3
                        && ttValue != VALUE_NONE))
                         tte->save(posKey, value_to_tt(value, ss->ply), ttPv,
                             BOUND_LOWER,
-                            depth - 3, move, ss->staticEval);
+                            depth - 3, move, ss->staticEval, engine.tt.generation());
                     return value;
                 }
             }
@@ -986,13 +1262,16 @@ moves_loop: // When in check, search starts from here
     value = bestValue;
     singularQuietLMR = moveCountPruning = false;
     ttCapture = ttMove && pos.capture_or_promotion(ttMove);
+    abdada = engine.threads.abdada && !rootNode && depth >= AbdadaDepth;
+    deferredCount = deferredIdx = 0;
 
     // Mark this node as being searched
     ThreadHolding th(thisThread, posKey, ss->ply);
 
     // Step 11. Loop through all pseudo-legal moves until no moves remain
-    // or a beta cutoff occurs.
-    while ((move = mp.next_move(moveCountPruning)) != MOVE_NONE)
+    // or a beta cutoff occurs. The moves deferred in ABDADA mode come last.
+    while (   (move = mp.next_move(moveCountPruning)) != MOVE_NONE
+           || (deferredIdx < deferredCount && (move = deferredMoves[deferredIdx++])))
     {
       assert(is_ok(move));
 
@@ -1011,9 +1290,24 @@ moves_loop: // When in check, search starts from here
       if (!rootNode && !pos.legal(move))
           continue;
 
+      // Defer the move if another thread is searching its position, but never
+      // the first move (young brothers wait) or a move already deferred.
+      if (   abdada
+          && moveCount
+          && !deferredIdx
+          && deferredCount < 32
+          && engine.threads.being_searched(pos.key_after(move)))
+      {
+          deferredMoves[deferredCount++] = move;
+          continue;
+      }
+
       ss->moveCount = ++moveCount;
 
-      if (rootNode && thisThread == Threads.main() && Time.elapsed() > 3000)
+      if (   rootNode
+          && thisThread == engine.threads.main()
+          && !engine.limits.silent
+          && engine.time.elapsed() > 3000)
           sync_cout << "info depth " << depth
                     << " currmove " << UCI::move(move, pos.is_chess960())
                     << " currmovenumber " << moveCount + thisThread->pvIdx << sync_endl;
@@ -1024,6 +1318,7 @@ moves_loop: // When in check, search starts from here
       captureOrPromotion = pos.capture_or_promotion(move);
       movedPiece = pos.moved_piece(move);
       givesCheck = pos.gives_check(move);
+      tte = reprobe_tt(thisThread, tte, posKey, ttEpoch); // After the previous moves
 
       // Indicate PvNodes that will probably fail low if node was searched with non-PV search
       // at depth equal or greater to current depth and result of this search was far below alpha
@@ -1045,7 +1340,7 @@ moves_loop: // When in check, search starts from here
           moveCountPruning = moveCount >= futility_move_count(improving, depth);
 
           // Reduced depth of the next LMR search
-          int lmrDepth = std::max(newDepth - reduction(improving, depth, moveCount), 0);
+          int lmrDepth = std::max(newDepth - reduction(engine.threads.reductions, improving, depth, moveCount), 0);
 
           if (   captureOrPromotion
               || givesCheck)
@@ -1054,11 +1349,17 @@ moves_loop: // When in check, search starts from here
               if (   !givesCheck
                   && lmrDepth < 1
                   && captureHistory[movedPiece][to_sq(move)][type_of(pos.piece_on(to_sq(move)))] < 0)
+              {
+                  thisThread->searchStats.inc(SearchStats::HISTORY_PRUNED, depth);
                   continue;
+              }
 
               // SEE based pruning
               if (!pos.see_ge(move, Value(-218) * depth)) // (~25 Elo)
+              {
+                  thisThread->searchStats.inc(SearchStats::SEE_PRUNED, depth);
                   continue;
+              }
           }
           else
           {
@@ -1066,7 +1367,10 @@ moves_loop: // When in check, search starts from here
               if (   lmrDepth < 4 + ((ss-1)->statScore > 0 || (ss-1)->moveCount == 1)
                   && (*contHist[0])[movedPiece][to_sq(move)] < CounterMovePruneThreshold
                   && (*contHist[1])[movedPiece][to_sq(move)] < CounterMovePruneThreshold)
+              {
+                  thisThread->searchStats.inc(SearchStats::HISTORY_PRUNED, depth);
                   continue;
+              }
 
               // Futility pruning: parent node (~5 Elo)
               if (   lmrDepth < 7
@@ -1076,11 +1380,17 @@ moves_loop: // When in check, search starts from here
                     + (*contHist[1])[movedPiece][to_sq(move)]
                     + (*contHist[3])[movedPiece][to_sq(move)]
                     + (*contHist[5])[movedPiece][to_sq(move)] / 3 < 26237)
+              {
+                  thisThread->searchStats.inc(SearchStats::FUTILITY_PRUNED, depth);
                   continue;
+              }
 
               // Prune moves with negative SEE (~20 Elo)
               if (!pos.see_ge(move, Value(-(30 - std::min(lmrDepth, 18)) * lmrDepth * lmrDepth)))
+              {
+                  thisThread->searchStats.inc(SearchStats::SEE_PRUNED, depth);
                   continue;
+              }
           }
       }
 
@@ -1147,7 +1457,7 @@ moves_loop: // When in check, search starts from here
       newDepth += extension;
 
       // Speculative prefetch as early as possible
-      prefetch(TT.first_entry(pos.key_after(move)));
+      prefetch(engine.tt.first_entry(pos.key_after(move)));
 
       // Update the current move (this must be done after singular extension search)
       ss->currentMove = move;
@@ -1157,8 +1467,14 @@ moves_loop: // When in check, search starts from here
                                                                 [to_sq(move)];
 
       // Step 14. Make the move
+      if (abdada)
+          engine.threads.set_searching(pos.key_after(move), true);
+
       pos.do_move(move, st, givesCheck);
 
+      if (PvNode && moveCount > 1)
+          thisThread->searchStats.inc(SearchStats::PVS_SEARCHED, depth);
+
       // Step 15. Reduced depth search (LMR, ~200 Elo). If the move fails high it will be
       // re-searched at full depth.
       if (    depth >= 3
@@ -1170,7 +1486,7 @@ moves_loop: // When in check, search starts from here
               || (!PvNode && !formerPv && captureHistory[movedPiece][to_sq(move)][type_of(pos.captured_piece())] < 4506)
               || thisThread->ttHitAverage < 432 * TtHitAverageResolution * TtHitAverageWindow / 1024))
       {
-          Depth r = reduction(improving, depth, moveCount);
+          Depth r = reduction(engine.threads.reductions, improving, depth, moveCount);
 
           // Decrease reduction if the ttHit running average is large
           if (thisThread->ttHitAverage > 537 * TtHitAverageResolution * TtHitAverageWindow / 1024)
@@ -1258,6 +1574,12 @@ moves_loop: // When in check, search starts from here
           doFullDepthSearch = value > alpha && d != newDepth;
 
           didLMR = true;
+
+          if (d != newDepth)
+              thisThread->searchStats.inc(SearchStats::LMR_REDUCED, depth);
+
+          if (doFullDepthSearch)
+              thisThread->searchStats.inc(SearchStats::LMR_RESEARCHED, depth);
       }
       else
       {
@@ -1286,6 +1608,9 @@ moves_loop: // When in check, search starts from here
       // parent node fail low with value <= alpha and try another move.
       if (PvNode && (moveCount == 1 || (value > alpha && (rootNode || value < beta))))
       {
+          if (moveCount > 1)
+              thisThread->searchStats.inc(SearchStats::PVS_RESEARCHED, depth);
+
           (ss+1)->pv = pv;
           (ss+1)->pv[0] = MOVE_NONE;
 
@@ -1296,13 +1621,16 @@ moves_loop: // When in check, search starts from here
       // Step 17. Undo move
       pos.undo_move(move);
 
+      if (abdada)
+          engine.threads.set_searching(pos.key_after(move), false);
+
       assert(value > -VALUE_INFINITE && value < VALUE_INFINITE);
 
       // Step 18. Check for a new best move
       // Finished searching the move. If a stop occurred, the return value of
       // the search cannot be trusted, and we return immediately without
       // updating best move, PV and TT.
-      if (Threads.stop.load(std::memory_order_relaxed))
+      if (engine.threads.stop.load(std::memory_order_relaxed))
           return VALUE_ZERO;
 
       if (rootNode)
@@ -1351,6 +1679,10 @@ moves_loop: // When in check, search starts from here
               {
                   assert(value >= beta); // Fail high
                   ss->statScore = 0;
+
+                  thisThread->searchStats.inc(SearchStats::CUTOFFS, depth);
+                  if (moveCount == 1)
+                      thisThread->searchStats.inc(SearchStats::FIRST_MOVE_CUTOFFS, depth);
                   break;
               }
           }
@@ -1371,7 +1703,7 @@ moves_loop: // When in check, search starts from here
     // completed. But in this case bestValue is valid because we have fully
     // searched our subtree, and we can anyhow save the result in TT.
     /*
-       if (Threads.stop)
+       if (engine.threads.stop)
         return VALUE_DRAW;
     */
 
@@ -1410,10 +1742,13 @@ moves_loop: // When in check, search starts from here
 
     // Write gathered information in transposition table
     if (!excludedMove && !(rootNode && thisThread->pvIdx))
+    {
+        tte = reprobe_tt(thisThread, tte, posKey, ttEpoch);
         tte->save(posKey, value_to_tt(bestValue, ss->ply), ss->ttPv,
                   bestValue >= beta ? BOUND_LOWER :
                   PvNode && bestMove ? BOUND_EXACT : BOUND_UPPER,
-                  depth, bestMove, ss->staticEval);
+                  depth, bestMove, ss->staticEval, engine.tt.generation());
+    }
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1434,7 +1769,6 @@ moves_loop: // When in check, search starts from here
 
     Move pv[MAX_PLY+1];
     StateInfo st;
-    ASSERT_ALIGNED(&st, Eval::NNUE::kCacheLineSize);
 
     TTEntry* tte;
     Key posKey;
@@ -1452,11 +1786,14 @@ moves_loop: // When in check, search starts from here
     }
 
     Thread* thisThread = pos.this_thread();
+    Engine& engine = thisThread->engine;
     (ss+1)->ply = ss->ply + 1;
     bestMove = MOVE_NONE;
     ss->inCheck = pos.checkers();
     moveCount = 0;
 
+    thisThread->searchStats.inc(SearchStats::NODES, 0);
+
     // Check for an immediate draw or maximum ply reached
     if (   pos.is_draw(ss->ply)
         || ss->ply >= MAX_PLY)
@@ -1471,7 +1808,7 @@ moves_loop: // When in check, search starts from here
                                                   : DEPTH_QS_NO_CHECKS;
     // Transposition table lookup
     posKey = pos.key();
-    tte = TT.probe(posKey, ss->ttHit);
+    tte = probe_tt(thisThread, posKey, ss->ttHit);
     ttValue = ss->ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
     ttMove = ss->ttHit ? tte->move() : MOVE_NONE;
     pvHit = ss->ttHit && tte->is_pv();
@@ -1482,7 +1819,10 @@ moves_loop: // When in check, search starts from here
         && ttValue != VALUE_NONE // Only in case of TT access race
         && (ttValue >= beta ? (tte->bound() & BOUND_LOWER)
                             : (tte->bound() & BOUND_UPPER)))
+    {
+        thisThread->searchStats.inc(SearchStats::TT_CUTS, 0);
         return ttValue;
+    }
 
     // Evaluate the position statically
     if (ss->inCheck)
@@ -1496,7 +1836,7 @@ moves_loop: // When in check, search starts from here
         {
             // Never assume anything about values stored in TT
             if ((ss->staticEval = bestValue = tte->eval()) == VALUE_NONE)
-                ss->staticEval = bestValue = evaluate(pos);
+                ss->staticEval = bestValue = engine.evalCache.evaluate(pos);
 
             // Can ttValue be used as a better position evaluation?
             if (    ttValue != VALUE_NONE
@@ -1507,7 +1847,7 @@ moves_loop: // When in check, search starts from here
             // In case of null move search use previous static eval with a different sign
             // and addition of two tempos
             ss->staticEval = bestValue =
-            (ss-1)->currentMove != MOVE_NULL ? evaluate(pos)
+            (ss-1)->currentMove != MOVE_NULL ? engine.evalCache.evaluate(pos)
                                              : -(ss-1)->staticEval + 2 * Tempo;
 
         // Stand pat. Return immediately if static value is at least beta
@@ -1516,7 +1856,7 @@ moves_loop: // When in check, search starts from here
             // Save gathered info in transposition table
             if (!ss->ttHit)
                 tte->save(posKey, value_to_tt(bestValue, ss->ply), false, BOUND_LOWER,
-                          DEPTH_NONE, MOVE_NONE, ss->staticEval);
+                          DEPTH_NONE, MOVE_NONE, ss->staticEval, engine.tt.generation());
 
             return bestValue;
         }
@@ -1567,6 +1907,7 @@ moves_loop: // When in check, search starts from here
           if (futilityValue <= alpha)
           {
               bestValue = std::max(bestValue, futilityValue);
+              thisThread->searchStats.inc(SearchStats::FUTILITY_PRUNED, 0);
               continue;
           }
 
@@ -1580,10 +1921,13 @@ moves_loop: // When in check, search starts from here
       // Do not search moves with negative SEE values
       if (    bestValue > VALUE_TB_LOSS_IN_MAX_PLY
           && !pos.see_ge(move))
+      {
+          thisThread->searchStats.inc(SearchStats::SEE_PRUNED, 0);
           continue;
+      }
 
       // Speculative prefetch as early as possible
-      prefetch(TT.first_entry(pos.key_after(move)));
+      prefetch(engine.tt.first_entry(pos.key_after(move)));
 
       // Check for legality just before making the move
       if (!pos.legal(move))
@@ -1627,7 +1971,12 @@ moves_loop: // When in check, search starts from here
               if (PvNode && value < beta) // Update alpha here!
                   alpha = value;
               else
+              {
+                  thisThread->searchStats.inc(SearchStats::CUTOFFS, 0);
+                  if (moveCount == 1)
+                      thisThread->searchStats.inc(SearchStats::FIRST_MOVE_CUTOFFS, 0);
                   break; // Fail high
+              }
           }
        }
     }
@@ -1645,7 +1994,7 @@ moves_loop: // When in check, search starts from here
     tte->save(posKey, value_to_tt(bestValue, ss->ply), pvHit,
               bestValue >= beta ? BOUND_LOWER :
               PvNode && bestValue > oldAlpha  ? BOUND_EXACT : BOUND_UPPER,
-              ttDepth, bestMove, ss->staticEval);
+              ttDepth, bestMove, ss->staticEval, engine.tt.generation());
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1806,9 +2155,8 @@ moves_loop: // When in check, search starts from here
   // When playing with strength handicap, choose best move among a set of RootMoves
   // using a statistical rule dependent on 'level'. Idea by Heinz van Saanen.
 
-  Move Skill::pick_best(size_t multiPV) {
+  Move Skill::pick_best(const RootMoves& rootMoves, size_t multiPV) {
 
-    const RootMoves& rootMoves = Threads.main()->rootMoves;
     static PRNG rng(now()); // PRNG sequence should be non-deterministic
 
     // RootMoves are already sorted by score in descending order
@@ -1848,12 +2196,10 @@ void MainThread::check_time() {
       return;
 
   // When using nodes, ensure checking rate is not lower than 0.1% of nodes
-  callsCnt = Limits.nodes ? std::min(1024, int(Limits.nodes / 1024)) : 1024;
+  callsCnt = engine.limits.nodes ? std::min(1024, int(engine.limits.nodes / 1024)) : 1024;
 
-  static TimePoint lastInfoTime = now();
-
-  TimePoint elapsed = Time.elapsed();
-  TimePoint tick = Limits.startTime + elapsed;
+  TimePoint elapsed = engine.time.elapsed();
+  TimePoint tick = engine.limits.startTime + elapsed;
 
   if (tick - lastInfoTime >= 1000)
   {
@@ -1865,10 +2211,12 @@ void MainThread::check_time() {
   if (ponder)
       return;
 
-  if (   (Limits.use_time_management() && (elapsed > Time.maximum() - 10 || stopOnPonderhit))
-      || (Limits.movetime && elapsed >= Limits.movetime)
-      || (Limits.nodes && Threads.nodes_searched() >= (uint64_t)Limits.nodes))
-      Threads.stop = true;
+  if (   (engine.limits.use_time_management() && (elapsed > engine.time.maximum() - 10 || stopOnPonderhit))
+      || (engine.limits.movetime && elapsed >= engine.limits.movetime)
+      || (   engine.limits.nodes
+          && !engine.threads.deterministic // Checked at the end of each epoch instead
+          && engine.threads.nodes_searched() >= (uint64_t)engine.limits.nodes))
+      engine.threads.stop = true;
 }
 
 
@@ -1877,13 +2225,22 @@ void MainThread::check_time() {
 
 string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
 
+  const Engine& engine = pos.this_thread()->engine;
   std::stringstream ss;
-  TimePoint elapsed = Time.elapsed() + 1;
-  const RootMoves& rootMoves = pos.this_thread()->rootMoves;
-  size_t pvIdx = pos.this_thread()->pvIdx;
+  TimePoint elapsed = engine.time.elapsed() + 1;
+  const ThreadPool& threads = engine.threads;
+  std::vector<Depth> depths;
+  RootMoves lines;
+
+  // In parallel MultiPV mode show the lines of all the groups of threads
+  if (threads.pvGroups > 1)
+      lines = threads.multipv_lines(pos.this_thread()->rootMoves, depths);
+
+  const RootMoves& rootMoves = threads.pvGroups > 1 ? lines : pos.this_thread()->rootMoves;
+  size_t pvIdx = threads.pvGroups > 1 ? rootMoves.size() : pos.this_thread()->pvIdx;
   size_t multiPV = std::min((size_t)Options["MultiPV"], rootMoves.size());
-  uint64_t nodesSearched = Threads.nodes_searched();
-  uint64_t tbHits = Threads.tb_hits() + (TB::RootInTB ? rootMoves.size() : 0);
+  uint64_t nodesSearched = engine.threads.nodes_searched();
+  uint64_t tbHits = engine.threads.tb_hits() + (threads.tbConfig.rootInTB ? rootMoves.size() : 0);
 
   for (size_t i = 0; i < multiPV; ++i)
   {
@@ -1892,13 +2249,14 @@ string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
       if (depth == 1 && !updated && i > 0)
           continue;
 
-      Depth d = updated ? depth : std::max(1, depth - 1);
+      Depth d =  i < depths.size() && depths[i] ? depths[i]
+               : updated ? depth : std::max(1, depth - 1);
       Value v = updated ? rootMoves[i].score : rootMoves[i].previousScore;
 
       if (v == -VALUE_INFINITE)
           v = VALUE_ZERO;
 
-      bool tb = TB::RootInTB && abs(v) < VALUE_MATE_IN_MAX_PLY;
+      bool tb = threads.tbConfig.rootInTB && abs(v) < VALUE_MATE_IN_MAX_PLY;
       v = tb ? rootMoves[i].tbScore : v;
 
       if (ss.rdbuf()->in_avail()) // Not at first line
@@ -1920,7 +2278,7 @@ string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
          << " nps "      << nodesSearched * 1000 / elapsed;
 
       if (elapsed > 1000) // Earlier makes little sense
-          ss << " hashfull " << TT.hashfull();
+          ss << " hashfull " << engine.tt.hashfull();
 
       ss << " tbhits "   << tbHits
          << " time "     << elapsed
@@ -1942,7 +2300,6 @@ string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
 bool RootMove::extract_ponder_from_tt(Position& pos) {
 
     StateInfo st;
-    ASSERT_ALIGNED(&st, Eval::NNUE::kCacheLineSize);
 
     bool ttHit;
 
@@ -1952,7 +2309,7 @@ bool RootMove::extract_ponder_from_tt(Position& pos) {
         return false;
 
     pos.do_move(pv[0], st);
-    TTEntry* tte = TT.probe(pos.key(), ttHit);
+    TTEntry* tte = pos.this_thread()->engine.tt.probe(pos.key(), ttHit);
 
     if (ttHit)
     {
@@ -1965,36 +2322,39 @@ bool RootMove::extract_ponder_from_tt(Position& pos) {
     return pv.size() > 1;
 }
 
-void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
+/// Tablebases::rank_root_moves() ranks the root moves with the tablebases, if the
+/// root is in them, and returns how to probe them during the search.
 
-    RootInTB = false;
-    UseRule50 = bool(Options["Syzygy50MoveRule"]);
-    ProbeDepth = int(Options["SyzygyProbeDepth"]);
-    Cardinality = int(Options["SyzygyProbeLimit"]);
+Tablebases::Config Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
+
+    Config config;
+    config.useRule50 = bool(Options["Syzygy50MoveRule"]);
+    config.probeDepth = int(Options["SyzygyProbeDepth"]);
+    config.cardinality = int(Options["SyzygyProbeLimit"]);
     bool dtz_available = true;
 
     // Tables with fewer pieces than SyzygyProbeLimit are searched with
     // ProbeDepth == DEPTH_ZERO
-    if (Cardinality > MaxCardinality)
+    if (config.cardinality > MaxCardinality)
     {
-        Cardinality = MaxCardinality;
-        ProbeDepth = 0;
+        config.cardinality = MaxCardinality;
+        config.probeDepth = 0;
     }
 
-    if (Cardinality >= popcount(pos.pieces()) && !pos.can_castle(ANY_CASTLING))
+    if (config.cardinality >= popcount(pos.pieces()) && !pos.can_castle(ANY_CASTLING))
     {
         // Rank moves using DTZ tables
-        RootInTB = root_probe(pos, rootMoves);
+        config.rootInTB = root_probe(pos, rootMoves);
 
-        if (!RootInTB)
+        if (!config.rootInTB)
         {
             // DTZ tables are missing; try to rank moves using WDL tables
             dtz_available = false;
-            RootInTB = root_probe_wdl(pos, rootMoves);
+            config.rootInTB = root_probe_wdl(pos, rootMoves);
         }
     }
 
-    if (RootInTB)
+    if (config.rootInTB)
     {
         // Sort moves according to TB rank
         std::stable_sort(rootMoves.begin(), rootMoves.end(),
@@ -2002,7 +2362,7 @@ void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
 
         // Probe during search only if DTZ is not available and we are winning
         if (dtz_available || rootMoves[0].tbScore <= VALUE_DRAW)
-            Cardinality = 0;
+            config.cardinality = 0;
     }
     else
     {
@@ -2010,4 +2370,6 @@ void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
         for (auto& m : rootMoves)
             m.tbRank = 0;
     }
+
+    return config;
 }
@@ -19,6 +19,8 @@
 #ifndef SEARCH_H_INCLUDED
 #define SEARCH_H_INCLUDED
 
+#include <atomic>
+#include <string>
 #include <vector>
 
 #include "misc.h"
@@ -26,6 +28,7 @@
 #include "types.h"
 
 class Position;
+struct ThreadPool;
 
 namespace Search {
 
@@ -87,6 +90,7 @@ struct LimitsType {
     time[WHITE] = time[BLACK] = inc[WHITE] = inc[BLACK] = npmsec = movetime = TimePoint(0);
     movestogo = depth = mate = perft = infinite = 0;
     nodes = 0;
+    silent = false;
   }
 
   bool use_time_management() const {
@@ -97,12 +101,60 @@ struct LimitsType {
   TimePoint time[COLOR_NB], inc[COLOR_NB], npmsec, movetime, startTime;
   int movestogo, depth, mate, perft, infinite;
   int64_t nodes;
+  std::string net;
+  bool silent; // No output at all, the caller reads the result from the threads
 };
 
-extern LimitsType Limits;
+/// PerftTable is the hash table of perft, a count of leaf nodes for each
+/// position and depth. It is shared by all the threads without locks: the key
+/// is stored xored with the data, so that an entry torn by a concurrent write
+/// does not match any key and reads as a miss. A pool keeps one, as large as
+/// the transposition table of its engine, allocated by the first perft and
+/// kept for the next ones: the counts do not depend on the root, so they stay
+/// valid from one perft to the next.
 
-void init();
-void clear();
+class PerftTable {
+
+  struct Entry {
+    std::atomic<uint64_t> key, data; // data is the count << 8 | depth
+  };
+
+public:
+  void resize(size_t mbSize) {
+    if (mbSize != size)
+        table = std::vector<Entry>(mbSize * 1024 * 1024 / sizeof(Entry)), size = mbSize;
+  }
+
+  bool probe(Key key, Depth depth, uint64_t& count) const {
+
+    const Entry& e = table[mul_hi64(key, table.size())];
+    uint64_t data = e.data.load(std::memory_order_relaxed);
+
+    if (   (e.key.load(std::memory_order_relaxed) ^ data) != key
+        || Depth(data & 0xFF) != depth)
+        return false;
+
+    count = data >> 8;
+    return true;
+  }
+
+  void save(Key key, Depth depth, uint64_t count) {
+
+    Entry& e = table[mul_hi64(key, table.size())];
+    uint64_t data = count << 8 | uint64_t(depth);
+
+    e.key.store(key ^ data, std::memory_order_relaxed);
+    e.data.store(data, std::memory_order_relaxed);
+  }
+
+private:
+  std::vector<Entry> table;
+  size_t size = 0; // In megabytes
+};
+
+struct Perft;
+
+void init(ThreadPool& threads);
 
 } // namespace Search
 
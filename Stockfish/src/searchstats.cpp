@@ -0,0 +1,148 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iomanip>
+#include <sstream>
+
+#include "searchstats.h"
+
+using namespace std;
+
+namespace SearchStats {
+
+namespace {
+
+  const char* CounterNames[COUNTER_NB] = {
+    "nodes", "tt_cuts", "futility_pruned", "null_move_tried", "null_move_cuts",
+    "history_pruned", "see_pruned", "lmr_reduced", "lmr_researched",
+    "pvs_searched", "pvs_researched", "cutoffs", "first_move_cutoffs"
+  };
+
+  // rate() returns a percentage, or a dash if nothing was counted
+
+  string rate(uint64_t n, uint64_t total) {
+
+    stringstream ss;
+
+    if (total)
+        ss << fixed << setprecision(1) << 100.0 * n / total;
+    else
+        ss << "-";
+
+    return ss.str();
+  }
+
+  // print_row() prints one row of the table, the counts of the moves pruned
+  // and the rates of the other counters.
+
+  template<typename T>
+  void print_row(ostream& os, const string& depth, const T& c) {
+
+    os << setw(5)  << depth
+       << setw(12) << c[NODES]
+       << setw(7)  << rate(c[TT_CUTS], c[NODES])
+       << setw(11) << c[FUTILITY_PRUNED]
+       << setw(11) << c[NULL_MOVE_TRIED]
+       << setw(7)  << rate(c[NULL_MOVE_CUTS], c[NULL_MOVE_TRIED])
+       << setw(11) << c[HISTORY_PRUNED]
+       << setw(11) << c[SEE_PRUNED]
+       << setw(11) << c[LMR_REDUCED]
+       << setw(7)  << rate(c[LMR_RESEARCHED], c[LMR_REDUCED])
+       << setw(7)  << rate(c[PVS_RESEARCHED], c[PVS_SEARCHED])
+       << setw(11) << c[CUTOFFS]
+       << setw(7)  << rate(c[FIRST_MOVE_CUTOFFS], c[CUTOFFS]) << "\n";
+  }
+
+  // Reporter formats the statistics collected by a policy, the disabled one has
+  // nothing to show.
+
+  template<bool Enable>
+  struct Reporter {
+    static string report(const Collector<Enable>&, bool) {
+      return "Search statistics are not compiled in, build with stats=yes";
+    }
+  };
+
+  template<>
+  struct Reporter<true> {
+    static string report(const Collector<true>& stats, bool json) {
+
+      array<uint64_t, COUNTER_NB> total = {};
+      stringstream ss;
+      bool first = true;
+
+      for (auto& row : stats.counts)
+          for (int i = 0; i < COUNTER_NB; ++i)
+              total[i] += row[i];
+
+      uint64_t qsNodes = stats.counts[0][NODES];
+
+      if (json)
+      {
+          ss << "{\"depths\": [";
+
+          for (int d = 0; d < MAX_PLY; ++d)
+              if (stats.counts[d][NODES])
+              {
+                  ss << (first ? "" : ", ") << "{\"depth\": " << d;
+                  for (int i = 0; i < COUNTER_NB; ++i)
+                      ss << ", \"" << CounterNames[i] << "\": " << stats.counts[d][i];
+                  ss << "}";
+                  first = false;
+              }
+
+          ss << "], \"total\": {";
+
+          for (int i = 0; i < COUNTER_NB; ++i)
+              ss << (i ? ", \"" : "\"") << CounterNames[i] << "\": " << total[i];
+
+          ss << "}, \"qsearch_share\": " << (total[NODES] ? double(qsNodes) / total[NODES] : 0.0) << "}";
+
+          return ss.str();
+      }
+
+      ss << setw(5)  << "depth"    << setw(12) << "nodes"   << setw(7)  << "ttcut%"
+         << setw(11) << "futility" << setw(11) << "nullmove" << setw(7)  << "null%"
+         << setw(11) << "history"  << setw(11) << "see"      << setw(11) << "lmr"
+         << setw(7)  << "lmr%"     << setw(7)  << "pvs%"     << setw(11) << "cutoffs"
+         << setw(7)  << "first%"   << "\n";
+
+      for (int d = 0; d < MAX_PLY; ++d)
+          if (stats.counts[d][NODES])
+              print_row(ss, d ? to_string(d) : "qs", stats.counts[d]);
+
+      print_row(ss, "all", total);
+
+      ss << "\nQsearch node share: " << rate(qsNodes, total[NODES]) << "%";
+
+      return ss.str();
+    }
+  };
+
+} // namespace
+
+
+/// SearchStats::report() formats the statistics gathered by the search, as a
+/// table with one row per depth or as a single JSON object. Row "qs" is the
+/// quiescence search. The rates are percentages of the relevant counts.
+
+string report(const Stats& stats, bool json) {
+  return Reporter<Enabled>::report(stats, json);
+}
+
+} // namespace SearchStats
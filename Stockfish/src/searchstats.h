@@ -0,0 +1,90 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SEARCHSTATS_H_INCLUDED
+#define SEARCHSTATS_H_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <string>
+
+#include "types.h"
+
+namespace SearchStats {
+
+/// The statistics are compiled in with 'make stats=yes', which defines
+/// USE_SEARCH_STATS. Otherwise the search uses the empty Collector below,
+/// whose calls the compiler removes altogether.
+
+#ifdef USE_SEARCH_STATS
+constexpr bool Enabled = true;
+#else
+constexpr bool Enabled = false;
+#endif
+
+enum Counter {
+  NODES,              // Nodes entered, row 0 counts the qsearch nodes
+  TT_CUTS,            // Early returns on a transposition table hit
+  FUTILITY_PRUNED,    // Nodes (child) and quiet moves (parent) pruned by futility
+  NULL_MOVE_TRIED,    // Null move searches
+  NULL_MOVE_CUTS,     // Null move searches that returned a cutoff
+  HISTORY_PRUNED,     // Moves pruned on capture or continuation history
+  SEE_PRUNED,         // Moves pruned on a negative static exchange
+  LMR_REDUCED,        // Moves searched with a reduced depth
+  LMR_RESEARCHED,     // Reduced searches that failed high and were repeated
+  PVS_SEARCHED,       // Null window searches of later moves at PV nodes
+  PVS_RESEARCHED,     // Null window searches repeated with the full window
+  CUTOFFS,            // Beta cutoffs in the moves loop
+  FIRST_MOVE_CUTOFFS, // Beta cutoffs on the first move searched
+  COUNTER_NB
+};
+
+/// Collector is the statistics policy of the search. Every thread owns one, and
+/// the search calls inc() with the depth of the node where something happened.
+/// The disabled policy is an empty struct, so that it costs nothing at all.
+
+template<bool Enable>
+struct Collector {
+  void inc(Counter, Depth) {}
+  void clear() {}
+  Collector& operator+=(const Collector&) { return *this; }
+};
+
+template<>
+struct Collector<true> {
+
+  void inc(Counter c, Depth d) { ++counts[std::clamp(int(d), 0, MAX_PLY - 1)][c]; }
+  void clear() { counts = {}; }
+
+  Collector& operator+=(const Collector& c) {
+    for (int d = 0; d < MAX_PLY; ++d)
+        for (int i = 0; i < COUNTER_NB; ++i)
+            counts[d][i] += c.counts[d][i];
+    return *this;
+  }
+
+  std::array<std::array<uint64_t, COUNTER_NB>, MAX_PLY> counts = {};
+};
+
+typedef Collector<Enabled> Stats;
+
+std::string report(const Stats& stats, bool json);
+
+} // namespace SearchStats
+
+#endif // #ifndef SEARCHSTATS_H_INCLUDED
@@ -31,6 +31,7 @@
 #include "../bitboard.h"
 #include "../movegen.h"
 #include "../position.h"
+#include "../profiler.h"
 #include "../search.h"
 #include "../types.h"
 #include "../uci.h"
@@ -1414,6 +1415,8 @@ void Tablebases::init(const std::string& paths) {
 //  2 : win
 WDLScore Tablebases::probe_wdl(Position& pos, ProbeState* result) {
 
+  Profiler::Scope<Profiler::TB_PROBE> scope;
+
     *result = OK;
     return search<false>(pos, result);
 }
@@ -1446,6 +1449,8 @@ WDLScore Tablebases::probe_wdl(Position& pos, ProbeState* result) {
 // then do not accept moves leading to dtz + 50-move-counter == 100.
 int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
 
+  Profiler::Scope<Profiler::TB_PROBE> scope;
+
     *result = OK;
     WDLScore wdl = search<true>(pos, result);
 
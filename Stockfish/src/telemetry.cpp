@@ -0,0 +1,253 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <csignal>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "engine.h"
+#include "misc.h"
+#include "telemetry.h"
+
+using namespace std;
+
+namespace {
+
+  // How long join() waits for the last line before giving up on the reporter
+  constexpr auto JoinTimeout = std::chrono::milliseconds(100);
+
+  // Opening and writing a file without blocking, as far as the OS allows
+#ifdef _WIN32
+  int open_file(const string& name) {
+    return _open(name.c_str(), _O_WRONLY | _O_APPEND | _O_CREAT, _S_IREAD | _S_IWRITE);
+  }
+  int write_file(int fd, const string& s) { return _write(fd, s.data(), unsigned(s.size())); }
+  void close_file(int fd) { _close(fd); }
+#else
+  int open_file(const string& name) {
+    return open(name.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_NONBLOCK, 0644);
+  }
+  int write_file(int fd, const string& s) { return int(::write(fd, s.data(), s.size())); }
+  void close_file(int fd) { close(fd); }
+#endif
+
+} // namespace
+
+
+/// Telemetry::start() starts the reporter thread for the search about to begin.
+/// An interval of zero turns the telemetry off.
+
+void Telemetry::start(int intervalMs, const string& name) {
+
+  join();
+
+  if (intervalMs <= 0)
+      return;
+
+  if (!output || output->fileName != name)
+      output = std::make_shared<Output>(name);
+
+  report = std::make_shared<Report>();
+  reporter = std::thread(&Telemetry::run, this, report, output, intervalMs);
+}
+
+
+/// Telemetry::stop() is called by the main thread at the end of the search. It
+/// only tells the reporter to write its last line, without waiting for it.
+
+void Telemetry::stop() {
+
+  if (!report)
+      return;
+
+  {
+      std::lock_guard<std::mutex> lk(report->mutex);
+      report->stopped = true;
+  }
+
+  report->cv.notify_all();
+}
+
+
+/// Telemetry::join() waits for the reporter of the last search to be done, so
+/// that its last line reads the counters before they are reset. A reporter
+/// still stuck on the output after JoinTimeout, e.g. writing to a stderr that
+/// nobody reads, is left behind with its output, and the line is lost.
+
+void Telemetry::join() {
+
+  if (!reporter.joinable())
+      return;
+
+  bool done;
+
+  {
+      std::unique_lock<std::mutex> lk(report->mutex);
+      done = report->cv.wait_for(lk, JoinTimeout, [&]{ return report->done; });
+      report->abandoned = !done;
+  }
+
+  if (done)
+      reporter.join();
+  else
+  {
+      reporter.detach();
+      output.reset();
+  }
+
+  report.reset();
+}
+
+
+/// Telemetry::run() is the loop of the reporter thread, a line every interval
+/// and a last one when the search is stopped. The engine is only read with the
+/// lock held, the output is written without it.
+
+void Telemetry::run(shared_ptr<Report> rp, shared_ptr<Output> out, int intervalMs) {
+
+#ifndef _WIN32
+  // A FIFO whose reader went away fails the write with EPIPE, instead of
+  // killing the process. The signal is blocked for this thread only.
+  sigset_t pipe;
+  sigemptyset(&pipe);
+  sigaddset(&pipe, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe, nullptr);
+#endif
+
+  std::unique_lock<std::mutex> lk(rp->mutex);
+
+  if (rp->abandoned)
+      return;
+
+  Sample last = { engine.threads.goTime, 0, 0, 0 };
+
+  for (bool final = false; !final; )
+  {
+      final = rp->cv.wait_for(lk, std::chrono::milliseconds(intervalMs),
+                              [&]{ return rp->stopped || rp->abandoned; });
+
+      if (rp->abandoned)
+          return;
+
+      string s = line(last, final) + "\n";
+
+      lk.unlock();
+      out->write(s);
+      lk.lock();
+  }
+
+  rp->done = true;
+  rp->cv.notify_all();
+}
+
+
+/// Telemetry::Output::write() writes a line at once or drops it. The file is
+/// opened on the first line, and again after the reader of a FIFO went away.
+/// Opening a FIFO fails until it has a reader, and writing to it fails while
+/// it is full, instead of blocking.
+
+void Telemetry::Output::write(const string& s) {
+
+  if (fileName.empty())
+  {
+      write_file(2, s); // stderr
+      return;
+  }
+
+  if (fd < 0)
+  {
+      fd = open_file(fileName);
+
+      if (fd < 0)
+      {
+          if (errno != ENXIO && !warned)
+              cerr << "Unable to open telemetry file " << fileName << endl;
+
+          warned |= errno != ENXIO;
+          return;
+      }
+  }
+
+  // Lines are shorter than PIPE_BUF, so a FIFO takes all of a line or none
+  if (write_file(fd, s) < 0 && errno == EPIPE)
+  {
+      close_file(fd);
+      fd = -1;
+  }
+}
+
+
+Telemetry::Output::~Output() {
+
+  if (fd >= 0)
+      close_file(fd);
+}
+
+
+/// Telemetry::line() returns a line of telemetry as a JSON object. The rates,
+/// nodes per second and eval cache hits per probe, are over the time since the
+/// last line. The depths are those of the iterations the threads are in.
+
+string Telemetry::line(Sample& last, bool final) const {
+
+  const ThreadPool& threads = engine.threads;
+  Sample now = { now_us(), threads.nodes_searched(),
+                 threads.eval_cache_probes(), threads.eval_cache_hits() };
+  Depth minDepth = MAX_PLY, maxDepth = 0;
+
+  for (Thread* th : threads)
+  {
+      Depth d = th->iterationDepth.load(std::memory_order_relaxed);
+      minDepth = std::min(minDepth, d);
+      maxDepth = std::max(maxDepth, d);
+  }
+
+  int64_t elapsed = std::max(now.timeUs - last.timeUs, int64_t(1));
+  uint64_t probes = now.evalCacheProbes - last.evalCacheProbes;
+
+  stringstream ss;
+
+  ss << "{\"time\": "     << (now.timeUs - threads.goTime) / 1000
+     << ", \"depth\": "   << threads.main()->iterationDepth.load(std::memory_order_relaxed)
+     << ", \"mindepth\": " << minDepth
+     << ", \"maxdepth\": " << maxDepth
+     << ", \"nodes\": "   << now.nodes
+     << ", \"nps\": "     << (now.nodes - last.nodes) * 1000000 / elapsed
+     << ", \"hashfull\": " << engine.tt.hashfull()
+     << ", \"tbhits\": "  << threads.tb_hits()
+     << ", \"evalcacheprobes\": " << probes
+     << ", \"evalcachehitrate\": " << std::fixed << std::setprecision(3)
+     << (probes ? double(now.evalCacheHits - last.evalCacheHits) / probes : 0.0)
+     << ", \"final\": "   << (final ? "true" : "false") << "}";
+
+  last = now;
+  return ss.str();
+}
@@ -0,0 +1,85 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TELEMETRY_H_INCLUDED
+#define TELEMETRY_H_INCLUDED
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class Engine;
+
+/// Telemetry writes the progress of the searches of an engine to a file, a FIFO
+/// or stderr, one JSON line every few milliseconds. The lines are written by a
+/// reporter thread of its own, which only reads the counters the search threads
+/// keep anyway, so that the search does not wait on the output. The output does
+/// not block either: the lines a FIFO has no room or no reader for are dropped.
+
+class Telemetry {
+
+  // Counters at the time of the last line, for the rates over the interval
+  struct Sample {
+    int64_t timeUs;
+    uint64_t nodes, evalCacheProbes, evalCacheHits;
+  };
+
+  // The file the lines go to, kept open from one search to the next
+  struct Output {
+    explicit Output(const std::string& name) : fileName(name) {}
+   ~Output();
+    void write(const std::string& line);
+
+    std::string fileName; // Empty for stderr
+    int fd = -1;
+    bool warned = false;
+  };
+
+  // Shared by the reporter of a search and join(), which gives up on the
+  // reporter if it stays stuck on the output. The reporter then no longer
+  // reads the engine, which may be gone when its write returns.
+  struct Report {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopped = false, done = false, abandoned = false;
+  };
+
+public:
+  explicit Telemetry(const Engine& e) : engine(e) {}
+ ~Telemetry() { stop(); join(); }
+  Telemetry(const Telemetry&) = delete;
+  Telemetry& operator=(const Telemetry&) = delete;
+
+  void start(int intervalMs, const std::string& fileName);
+  void stop();
+  void join();
+
+private:
+  void run(std::shared_ptr<Report> report, std::shared_ptr<Output> output, int intervalMs);
+  std::string line(Sample& last, bool final) const;
+
+  const Engine& engine;
+  std::thread reporter;
+  std::shared_ptr<Report> report;
+  std::shared_ptr<Output> output;
+};
+
+#endif // #ifndef TELEMETRY_H_INCLUDED
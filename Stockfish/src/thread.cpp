@@ -17,22 +17,111 @@
 */
 
 #include <cassert>
+#include <climits>
+#include <cstdlib>
 
 #include <algorithm> // For std::count
+#include <iostream>
+#include "engine.h"
 #include "movegen.h"
 #include "search.h"
 #include "thread.h"
 #include "uci.h"
 #include "syzygy/tbprobe.h"
 #include "tt.h"
+#include "nnue/evaluate_nnue.h"
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace {
+
+  // cpu_relax() tells the CPU that we are spinning, which on x86 slows down the
+  // loop and gives the execution units to the other hyperthread.
+
+  void cpu_relax() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+  }
+
+  // Spinning only makes sense when the writer can run at the same time as us
+  const int SpinCount = std::thread::hardware_concurrency() > 1 ? 1024 : 0;
+
+} // namespace
+
+
+/// ParkingWord::wait() spins until the word changes, then goes to sleep. The
+/// sleepers are counted before checking the word a last time, and the writers
+/// change the word before checking the count, so that no wake up can be missed.
+
+void ParkingWord::wait(uint32_t old) {
+
+  for (int i = 0; i < SpinCount; ++i)
+  {
+      if (word.load() != old)
+          return;
+
+      cpu_relax();
+  }
+
+  sleepers.fetch_add(1);
+
+#if defined(__linux__)
+  static_assert(sizeof(word) == sizeof(uint32_t), "Futex word must be 32 bits");
+
+  while (word.load() == old) // The kernel checks the word again before sleeping
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, old, nullptr, nullptr, 0);
+#else
+  std::unique_lock<std::mutex> lk(mutex);
+  cv.wait(lk, [&]{ return word.load() != old; });
+#endif
+
+  sleepers.fetch_sub(1);
+}
 
-ThreadPool Threads; // Global object
+
+/// ParkingWord::notify_all() wakes up the threads sleeping in wait(), if any
+
+void ParkingWord::notify_all() {
+
+  if (!sleepers.load())
+      return;
+
+#if defined(__linux__)
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+  { std::lock_guard<std::mutex> lk(mutex); } // A waiter is either asleep or sees the new word
+  cv.notify_all();
+#endif
+}
 
 
 /// Thread constructor launches the thread and waits until it goes to sleep
 /// in idle_loop(). Note that 'searching' and 'exit' should be already set.
 
-Thread::Thread(size_t n) : idx(n), stdThread(&Thread::idle_loop, this) {
+Thread::Thread(Engine& e, size_t n) : idx(n), searching(1), bell(n ? e.threads.helpersBell : searching),
+                                      stdThread(&Thread::idle_loop, this), engine(e) {
+
+  accumulators = static_cast<Eval::NNUE::Accumulator*>(
+      aligned_large_pages_alloc(AccumulatorStackSize * sizeof(Eval::NNUE::Accumulator)));
+
+  if (!accumulators)
+  {
+      std::cerr << "Failed to allocate the NNUE accumulator stack." << std::endl;
+      std::exit(EXIT_FAILURE); // Plain exit() is shadowed by Thread::exit
+  }
 
   wait_for_search_finished();
 }
@@ -43,11 +132,13 @@ Thread::Thread(size_t n) : idx(n), stdThread(&Thread::idle_loop, this) {
 
 Thread::~Thread() {
 
-  assert(!searching);
+  assert(!searching.load());
 
   exit = true;
   start_searching();
   stdThread.join();
+
+  aligned_large_pages_free(accumulators);
 }
 
 
@@ -71,28 +162,35 @@ void Thread::clear() {
 }
 
 
-/// Thread::start_searching() wakes up the thread that will start the search
+/// Thread::start_searching() wakes up the thread that will start the search.
+/// The helpers sleep on the bell of the pool, which ThreadPool::start_searching()
+/// rings once for all of them, after flagging each one with ringBell = false.
+
+void Thread::start_searching(bool ringBell) {
+
+  searching.store(1);
+
+  if (!ringBell)
+      return;
 
-void Thread::start_searching() {
+  if (&bell != &searching)
+      bell.fetch_add(1);
 
-  std::lock_guard<std::mutex> lk(mutex);
-  searching = true;
-  cv.notify_one(); // Wake up the thread in idle_loop()
+  bell.notify_all(); // Wake up the thread in idle_loop()
 }
 
 
-/// Thread::wait_for_search_finished() blocks on the condition variable
-/// until the thread has finished searching.
+/// Thread::wait_for_search_finished() blocks until the thread has finished
+/// searching.
 
 void Thread::wait_for_search_finished() {
 
-  std::unique_lock<std::mutex> lk(mutex);
-  cv.wait(lk, [&]{ return !searching; });
+  searching.wait(1);
 }
 
 
-/// Thread::idle_loop() is where the thread is parked, blocked on the
-/// condition variable, when it has no work to do.
+/// Thread::idle_loop() is where the thread is parked, spinning and then
+/// sleeping on its bell, when it has no work to do.
 
 void Thread::idle_loop() {
 
@@ -106,20 +204,122 @@ void Thread::idle_loop() {
 
   while (true)
   {
-      std::unique_lock<std::mutex> lk(mutex);
-      searching = false;
-      cv.notify_one(); // Wake up anyone waiting for search finished
-      cv.wait(lk, [&]{ return searching; });
+      searching.store(0);
+      searching.notify_all(); // Wake up anyone waiting for search finished
+
+      // Read the bell before checking our flag, so that a ring in between is
+      // seen by wait().
+      for (uint32_t ring = bell.load(); !searching.load(); ring = bell.load())
+          bell.wait(ring);
 
       if (exit)
           return;
 
-      lk.unlock();
+      Profiler::attach(profile); // The phases entered by this thread are charged to it
+      setup_root();
+
+      // The counters belong to the thread that opens them, so each thread
+      // opens its own group, once.
+      bool counting = engine.threads.perfCounters && (perfGroup.is_open() || perfGroup.open());
+
+      perfCounts = Perf::Counts();
+
+      if (counting)
+          perfGroup.start();
 
       search();
+      profile.stop();
+
+      if (counting)
+      {
+          perfGroup.stop();
+          perfCounts = perfGroup.read();
+      }
+  }
+}
+
+/// Thread::setup_root() sets up the root position and the root moves from the
+/// copies staged by ThreadPool::start_thinking(). Each thread runs it as it wakes
+/// up, so the helpers set up their roots in parallel. The main thread wakes up
+/// first, and generates the root moves before starting the helpers.
+
+void Thread::setup_root() {
+
+  ThreadPool& threads = engine.threads;
+
+  rootPos.set(threads.setupPos, &rootState, this);
+  rootState.accumulator = accumulators;
+  accumulators[0].state[WHITE] = accumulators[0].state[BLACK] = Eval::NNUE::INIT;
+
+  if (this == threads.main())
+  {
+      const std::vector<Move>& searchMoves = engine.limits.searchmoves;
+
+      threads.rootMoves.clear();
+
+      for (const auto& m : MoveList<LEGAL>(rootPos))
+          if (   searchMoves.empty()
+              || std::count(searchMoves.begin(), searchMoves.end(), m))
+              threads.rootMoves.emplace_back(m);
+
+      threads.tbConfig = threads.rootMoves.empty() ? Tablebases::Config()
+                       : Tablebases::rank_root_moves(rootPos, threads.rootMoves);
+
+      nodes = 0; // The moves made by the tablebase probes are not searched
+
+      static_cast<MainThread*>(this)->seed_from_last_search();
+
+      // Each group of threads searches every pvGroups-th PV line. The lines not
+      // searched yet stand for the moves of the first lines meanwhile.
+      size_t multiPV = std::min(size_t(Options["MultiPV"]), threads.rootMoves.size());
+
+      threads.pvGroups =   Options["Parallel MultiPV"]
+                        && !threads.deterministic
+                        && int(Options["Skill Level"]) == 20
+                        && !Options["UCI_LimitStrength"] ? std::min(threads.size(), std::max(multiPV, size_t(1))) : 1;
+
+      threads.pvLines.assign(threads.rootMoves.begin(), threads.rootMoves.begin() + multiPV);
+      threads.pvLineDepths.assign(multiPV, 0);
   }
+
+  rootMoves = threads.rootMoves;
+  rootDepth = threads.startDepth;
+
+  if (threads.deterministic && ttBuffer.empty())
+      ttBuffer.resize(1 << 16); // Allocated by the thread using it
+
+  ttBuffer.clear(); // Left over if the last search was stopped within an epoch
+  searchStats.clear();
+  profile.clear();
+  epochEnd = ThreadPool::EpochNodes;
 }
 
+
+/// Thread::sync_epoch() is called by each thread in deterministic mode after it
+/// has searched another EpochNodes nodes. All the threads meet there, write the
+/// entries buffered during the epoch back to the shared transposition table and
+/// decide whether to stop, so that the threads depend on each other only at the
+/// end of each epoch, at the same node counts whatever the timing.
+
+void Thread::sync_epoch() {
+
+  ThreadPool& threads = engine.threads;
+
+  threads.epoch_barrier(false); // All the buffers are complete
+
+  if (threads.stop)
+      return;
+
+  for (Thread* th : threads)
+      th->ttBuffer.write_back(engine.tt, idx, threads.size());
+
+  threads.epoch_barrier(true); // The table is up to date
+
+  ttBuffer.clear();
+  epochEnd = nodes + ThreadPool::EpochNodes;
+}
+
+
 /// ThreadPool::set() creates/destroys threads to match the requested number.
 /// Created and launched threads will immediately go to sleep in idle_loop.
 /// Upon resizing, threads are recreated to allow for binding if necessary.
@@ -134,17 +334,14 @@ void ThreadPool::set(size_t requested) {
   }
 
   if (requested > 0) { // create new thread(s)
-      push_back(new MainThread(0));
+      push_back(new MainThread(engine, 0));
 
       while (size() < requested)
-          push_back(new Thread(size()));
+          push_back(new Thread(engine, size()));
       clear();
 
-      // Reallocate the hash with the new threadpool size
-      TT.resize(size_t(Options["Hash"]));
-
       // Init thread number dependent search params.
-      Search::init();
+      Search::init(*this);
   }
 }
 
@@ -157,8 +354,12 @@ void ThreadPool::clear() {
       th->clear();
 
   main()->callsCnt = 0;
+  main()->lastInfoTime = now();
+  main()->bestThread = main();
   main()->bestPreviousScore = VALUE_INFINITE;
   main()->previousTimeReduction = 1.0;
+  main()->lastPv.clear();
+  main()->lastPvKeys.clear();
 }
 
 
@@ -169,20 +370,20 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
                                 const Search::LimitsType& limits, bool ponderMode) {
 
   main()->wait_for_search_finished();
+  engine.telemetry.join(); // Done with the counters of the last search
 
   main()->stopOnPonderhit = stop = false;
   increaseDepth = true;
   main()->ponder = ponderMode;
-  Search::Limits = limits;
-  Search::RootMoves rootMoves;
-
-  for (const auto& m : MoveList<LEGAL>(pos))
-      if (   limits.searchmoves.empty()
-          || std::count(limits.searchmoves.begin(), limits.searchmoves.end(), m))
-          rootMoves.emplace_back(m);
-
-  if (!rootMoves.empty())
-      Tablebases::rank_root_moves(pos, rootMoves);
+  engine.limits = limits;
+  goTime = now_us();
+  deterministic = Options["Deterministic"] && size() > 1;
+  abdada = Options["SMP Mode"] == "ABDADA" && size() > 1 && !deterministic;
+  if (abdada && searching.empty())
+      searching = std::vector<std::atomic<Key>>(SearchingSize);
+  perfCounters = Options["Perf Counters"];
+  mainDone = false;
+  epochArrived = 0;
 
   // After ownership transfer 'states' becomes empty, so if we stop the search
   // and call 'go' again without setting a new position states.get() == NULL.
@@ -191,23 +392,182 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   if (states.get())
       setupStates = std::move(states); // Ownership transfer, states is now empty
 
-  // We use Position::set() to set root position across threads. But there are
-  // some StateInfo fields (previous, pliesFromNull, capturedPiece) that cannot
-  // be deduced from a fen string, so set() clears them and they are set from
-  // setupStates->back() later. The rootState is per thread, earlier states are shared
-  // since they are read-only.
+  // The root position is copied once here, so that 'pos' can change as soon as
+  // we return, and then copied again by each thread in setup_root(). The setup
+  // states behind it are shared since they are read-only.
+  setupPos.set(pos, &setupState, nullptr);
+
+  // The network is chosen once for the whole search, so that all threads use
+  // the same one even if another network is swapped in meanwhile.
+  Eval::NNUE::NetPtr net;
+  if (Eval::useNNUE)
+  {
+      if (!limits.net.empty())
+          net = Eval::NNUE::find_net(limits.net);
+      if (!net)
+          net = engine.net ? engine.net : Eval::NNUE::active_net();
+  }
+
   for (Thread* th : *this)
   {
       th->nodes = th->tbHits = th->nmpMinPly = th->bestMoveChanges = 0;
-      th->rootDepth = th->completedDepth = 0;
-      th->rootMoves = rootMoves;
-      th->rootPos.set(pos.fen(), pos.is_chess960(), &th->rootState, th);
-      th->rootState = setupStates->back();
+      th->nnueRefreshes = th->nnueUpdates = 0;
+      th->evalCacheProbes = th->evalCacheHits = 0;
+      th->evaluations = 0;
+      th->rootDepth = th->completedDepth = th->iterationDepth = 0;
+      th->iterations.clear();
+      th->net = net;
+      th->evalSalt = net ? net->salt : 0;
+      th->firstNodeLatency = 0;
   }
 
+  engine.telemetry.start(int(Options["Telemetry Interval"]), Options["Telemetry File"]);
   main()->start_searching();
 }
 
+/// ThreadPool::epoch_barrier() blocks until all the threads have reached it, or
+/// until the search is stopped from outside, e.g. by the GUI. The last thread to
+/// arrive at the end of an epoch stops the search if the main thread is done or
+/// the node limit is reached. The node counts are exact there, since all the
+/// threads are waiting.
+
+void ThreadPool::epoch_barrier(bool last) {
+
+  std::unique_lock<std::mutex> lk(epochMutex);
+  uint64_t epoch = epochCount;
+
+  if (++epochArrived == size())
+  {
+      if (   last
+          && (mainDone || (engine.limits.nodes && nodes_searched() >= uint64_t(engine.limits.nodes))))
+          stop = true;
+
+      epochArrived = 0;
+      ++epochCount;
+      epochCv.notify_all();
+  }
+  else
+      while (epochCount == epoch && !stop)
+          epochCv.wait_for(lk, std::chrono::milliseconds(1)); // Stop is not notified
+}
+
+
+/// ThreadPool::exclude_lines() moves the moves of the PV lines before 'line' to
+/// the front of 'moves', keeping the order of the other moves, and returns
+/// how many there are. A thread searching the line then looks for the best of
+/// the other moves, as in a MultiPV search by a single thread, but against the
+/// lines last published by the other groups.
+
+size_t ThreadPool::exclude_lines(size_t line, Search::RootMoves& moves) const {
+
+  std::vector<Move> excluded;
+
+  {
+      std::lock_guard<std::mutex> lk(pvLinesMutex);
+
+      for (size_t i = 0; i < line; ++i)
+          excluded.push_back(pvLines[i].pv[0]);
+  }
+
+  auto it = std::stable_partition(moves.begin(), moves.end(), [&](const Search::RootMove& rm) {
+      return std::count(excluded.begin(), excluded.end(), rm.pv[0]); });
+
+  return size_t(it - moves.begin());
+}
+
+
+/// ThreadPool::publish_line() records a PV line searched by a thread, unless a
+/// thread of the same group has already published it at a higher depth.
+
+void ThreadPool::publish_line(size_t line, const Search::RootMove& rm, Depth depth) {
+
+  std::lock_guard<std::mutex> lk(pvLinesMutex);
+
+  if (depth >= pvLineDepths[line])
+  {
+      pvLines[line] = rm;
+      pvLineDepths[line] = depth;
+  }
+}
+
+
+/// ThreadPool::multipv_lines() merges the PV lines published so far, best first,
+/// and returns them followed by the other moves of 'moves'. A move found by
+/// two lines, which happens when the lines before them change meanwhile, is kept
+/// once. The depth of each line is returned in 'depths', zero for the others.
+
+Search::RootMoves ThreadPool::multipv_lines(const Search::RootMoves& moves,
+                                            std::vector<Depth>& depths) const {
+
+  std::vector<std::pair<Search::RootMove, Depth>> lines;
+  Search::RootMoves merged;
+
+  {
+      std::lock_guard<std::mutex> lk(pvLinesMutex);
+
+      for (size_t i = 0; i < pvLines.size(); ++i)
+          if (   pvLineDepths[i]
+              && std::find_if(lines.begin(), lines.end(), [&](const auto& l) {
+                     return l.first.pv[0] == pvLines[i].pv[0]; }) == lines.end())
+              lines.emplace_back(pvLines[i], pvLineDepths[i]);
+  }
+
+  std::stable_sort(lines.begin(), lines.end(), [](const auto& a, const auto& b) {
+      return a.first < b.first; });
+
+  depths.clear();
+
+  for (const auto& l : lines)
+  {
+      merged.push_back(l.first);
+      depths.push_back(l.second);
+  }
+
+  for (const Search::RootMove& rm : moves)
+      if (std::find(merged.begin(), merged.end(), rm.pv[0]) == merged.end())
+      {
+          merged.push_back(rm);
+          merged.back().score = -VALUE_INFINITE; // Not a PV line of this search
+          depths.push_back(0);
+      }
+
+  return merged;
+}
+
+
+/// ThreadPool::multipv_pending() tells whether a parallel MultiPV search to a
+/// fixed depth still has lines to search to that depth, which is at most the
+/// last one of the iterative deepening. The search is over anyway once all the
+/// helpers have left their iterative deepening loops.
+
+bool ThreadPool::multipv_pending() const {
+
+  if (pvGroups <= 1 || !engine.limits.depth)
+      return false;
+
+  if (std::none_of(begin() + 1, end(), [](Thread* th) { return th->is_searching(); }))
+      return false;
+
+  Depth target = std::min(engine.limits.depth, MAX_PLY - 1);
+  std::lock_guard<std::mutex> lk(pvLinesMutex);
+
+  return std::any_of(pvLineDepths.begin(), pvLineDepths.end(), [&](Depth d) {
+             return d < target; });
+}
+
+
+/// ThreadPool::first_node_latency() returns the time in microseconds between
+/// the last 'go' and the first node of the slowest thread to start searching.
+
+int64_t ThreadPool::first_node_latency() const {
+
+  int64_t latency = 0;
+  for (Thread* th : *this)
+      latency = std::max(latency, th->firstNodeLatency);
+  return latency;
+}
+
+
 Thread* ThreadPool::get_best_thread() const {
 
     Thread* bestThread = front();
@@ -246,7 +606,10 @@ void ThreadPool::start_searching() {
 
     for (Thread* th : *this)
         if (th != front())
-            th->start_searching();
+            th->start_searching(false);
+
+    helpersBell.fetch_add(1);
+    helpersBell.notify_all(); // A single wake up for all the helpers
 }
 
 
@@ -28,9 +28,26 @@
 #include "material.h"
 #include "movepick.h"
 #include "pawns.h"
+#include "perfcounters.h"
 #include "position.h"
+#include "profiler.h"
 #include "search.h"
+#include "searchstats.h"
 #include "thread_win32_osx.h"
+#include "tt.h"
+#include "syzygy/tbprobe.h"
+
+class Engine;
+
+/// Iteration is the outcome of an iteration of a thread, completed at
+/// 'timeUs' microseconds from 'go' and 'nodes' nodes searched by all threads.
+
+struct Iteration {
+  Depth depth;
+  Move bestMove;
+  int64_t timeUs;
+  uint64_t nodes;
+};
 
 
 /// Thread class keeps together all the thread-related stuff. We use
@@ -40,21 +57,28 @@
 
 class Thread {
 
-  std::mutex mutex;
-  std::condition_variable cv;
+  // Room for the search stack plus the moves made by tablebase probes
+  static constexpr int AccumulatorStackSize = MAX_PLY + 16;
+
   size_t idx;
-  bool exit = false, searching = true; // Set before starting std::thread
+  bool exit = false;
+  ParkingWord searching; // Set before starting std::thread, one while searching
+  ParkingWord& bell;     // Rung to start the search, shared by the helpers
   NativeThread stdThread;
 
 public:
-  explicit Thread(size_t);
+  Thread(Engine&, size_t);
   virtual ~Thread();
   virtual void search();
   void clear();
   void idle_loop();
-  void start_searching();
+  void setup_root();
+  void sync_epoch();
+  void start_searching(bool ringBell = true);
   void wait_for_search_finished();
+  bool is_searching() const { return searching.load(); }
 
+  Engine& engine; // The engine this thread searches for
   Pawns::Table pawnsTable;
   Material::Table materialTable;
   size_t pvIdx, pvLast;
@@ -62,11 +86,26 @@ public:
   int selDepth, nmpMinPly;
   Color nmpColor;
   std::atomic<uint64_t> nodes, tbHits, bestMoveChanges;
+  std::atomic<uint64_t> nnueRefreshes, nnueUpdates;
+  std::atomic<uint64_t> evalCacheProbes, evalCacheHits;
+  std::atomic<uint64_t> evaluations; // Made by Eval::evaluate(), cache hits excluded
+  std::atomic<Depth> iterationDepth; // The rootDepth, as read by the telemetry
+  int64_t firstNodeLatency; // Microseconds from 'go' to the first node searched
+  uint64_t epochEnd;        // Node count at which the next epoch starts
+  TTBuffer ttBuffer;        // Used in deterministic mode only
+  SearchStats::Stats searchStats;
+  Profiler::Profile profile;
+  Perf::Group perfGroup;    // Hardware counters, opened by the thread itself
+  Perf::Counts perfCounts;  // Counted during the last search
 
   Position rootPos;
   StateInfo rootState;
+  Eval::NNUE::Accumulator* accumulators; // Indexed by ply, rootState uses the first one
+  Eval::NNUE::NetPtr net;                // Pinned for the whole search
+  Key evalSalt;                          // Identifies the evaluation in use, see EvalCache
   Search::RootMoves rootMoves;
   Depth rootDepth, completedDepth;
+  std::vector<Iteration> iterations; // Best move of each iteration of the search
   CounterMoveHistory counterMoves;
   ButterflyHistory mainHistory;
   LowPlyHistory lowPlyHistory;
@@ -85,11 +124,16 @@ struct MainThread : public Thread {
 
   void search() override;
   void check_time();
+  void seed_from_last_search();
 
   double previousTimeReduction;
   Value bestPreviousScore;
   Value iterValue[4];
   int callsCnt;
+  TimePoint lastInfoTime; // Of the last debug info printed by check_time()
+  Thread* bestThread; // The thread whose move was chosen by the last search
+  std::vector<Move> lastPv;    // The PV of the last search, and the keys of the
+  std::vector<Key> lastPvKeys; // positions along it, starting with the root
   bool stopOnPonderhit;
   std::atomic_bool ponder;
 };
@@ -101,6 +145,8 @@ struct MainThread : public Thread {
 
 struct ThreadPool : public std::vector<Thread*> {
 
+  explicit ThreadPool(Engine& e) : engine(e) {}
+
   void start_thinking(Position&, StateListPtr&, const Search::LimitsType&, bool = false);
   void clear();
   void set(size_t);
@@ -108,14 +154,80 @@ struct ThreadPool : public std::vector<Thread*> {
   MainThread* main()        const { return static_cast<MainThread*>(front()); }
   uint64_t nodes_searched() const { return accumulate(&Thread::nodes); }
   uint64_t tb_hits()        const { return accumulate(&Thread::tbHits); }
+  uint64_t nnue_refreshes() const { return accumulate(&Thread::nnueRefreshes); }
+  uint64_t nnue_updates()   const { return accumulate(&Thread::nnueUpdates); }
+  uint64_t eval_cache_probes() const { return accumulate(&Thread::evalCacheProbes); }
+  uint64_t eval_cache_hits()   const { return accumulate(&Thread::evalCacheHits); }
+  int64_t first_node_latency() const;
   Thread* get_best_thread() const;
   void start_searching();
   void wait_for_search_finished() const;
+  void epoch_barrier(bool last);
+  size_t exclude_lines(size_t line, Search::RootMoves& moves) const;
+  void publish_line(size_t line, const Search::RootMove& rm, Depth depth);
+  Search::RootMoves multipv_lines(const Search::RootMoves& moves, std::vector<Depth>& depths) const;
+  bool multipv_pending() const;
 
   std::atomic_bool stop, increaseDepth;
+  ParkingWord helpersBell; // Wakes up all the helpers at once, see start_searching()
+  int reductions[MAX_MOVES]; // [depth or moveNumber], depends on the number of threads
+
+  // Staged by start_thinking() for Thread::setup_root()
+  Position setupPos;
+  StateInfo setupState;
+  Search::RootMoves rootMoves;
+  Tablebases::Config tbConfig; // Set up with the root moves
+  Depth startDepth; // Of the iterative deepening, see MainThread::seed_from_last_search()
+  int64_t goTime;
+  Search::Perft* perft = nullptr; // Work shared by the threads of a perft
+  Search::PerftTable perftTable;
+  SearchStats::Stats searchStats; // Summed over the searches since the last report
+  Profiler::Profile profile;      // Idem
+
+  // Deterministic mode, see Thread::sync_epoch()
+  static constexpr uint64_t EpochNodes = 16384;
+  bool deterministic = false;
+  std::atomic_bool mainDone;
+
+  // ABDADA mode, the threads defer the moves that another thread is searching
+  bool abdada = false;
+
+  bool being_searched(Key key) const {
+    return searching[key & (SearchingSize - 1)].load(std::memory_order_relaxed) == key;
+  }
+
+  void set_searching(Key key, bool on) {
+    std::atomic<Key>& flag = searching[key & (SearchingSize - 1)];
+    if (on)
+        flag.store(key, std::memory_order_relaxed);
+    else if (flag.load(std::memory_order_relaxed) == key)
+        flag.store(0, std::memory_order_relaxed);
+  }
+
+  // The threads count hardware events while searching, see Perf::Group
+  bool perfCounters = false;
+
+  // Parallel MultiPV mode, the threads are split into groups searching different
+  // PV lines, which they publish in pvLines. Set up by the main thread.
+  size_t pvGroups = 1;
+  Search::RootMoves pvLines;
+  std::vector<Depth> pvLineDepths;
 
 private:
+  // In ABDADA mode the threads flag the positions they are searching, and defer
+  // the moves leading to a flagged position until the other moves are searched.
+  // A thread meeting the position later then most likely gets a TT hit instead
+  // of duplicating the work. The flags are those of our threads only.
+  static constexpr size_t SearchingSize = 32768;
+  std::vector<std::atomic<Key>> searching; // Allocated for the first ABDADA search
+
+  Engine& engine;
   StateListPtr setupStates;
+  std::mutex epochMutex;
+  mutable std::mutex pvLinesMutex;
+  std::condition_variable epochCv;
+  size_t epochArrived = 0;
+  uint64_t epochCount = 0;
 
   uint64_t accumulate(std::atomic<uint64_t> Thread::* member) const {
 
@@ -126,6 +238,4 @@ private:
   }
 };
 
-extern ThreadPool Threads;
-
 #endif // #ifndef THREAD_H_INCLUDED
@@ -19,6 +19,10 @@
 #ifndef THREAD_WIN32_OSX_H_INCLUDED
 #define THREAD_WIN32_OSX_H_INCLUDED
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
 #include <thread>
 
 /// On OSX threads other than the main thread are created with a reduced stack
@@ -63,4 +67,30 @@ typedef std::thread NativeThread;
 
 #endif
 
+
+/// ParkingWord is a 32 bit word that threads can wait on until it changes, like
+/// std::atomic<>::wait() of C++20. A waiter first spins for a while, which is
+/// often enough between two searches, then sleeps in the kernel: on a futex on
+/// Linux, on a condition variable elsewhere. A writer changes the word and then
+/// calls notify_all(), which costs a system call only if someone is sleeping.
+
+class ParkingWord {
+
+  std::atomic<uint32_t> word;
+  std::atomic<uint32_t> sleepers;
+#ifndef __linux__
+  std::mutex mutex;
+  std::condition_variable cv;
+#endif
+
+public:
+  explicit ParkingWord(uint32_t v = 0) : word(v), sleepers(0) {}
+
+  uint32_t load() const { return word.load(); }
+  void store(uint32_t v) { word.store(v); }
+  uint32_t fetch_add(uint32_t v) { return word.fetch_add(v); }
+  void wait(uint32_t old); // Returns once the word is no longer 'old'
+  void notify_all();
+};
+
 #endif // #ifndef THREAD_WIN32_OSX_H_INCLUDED
@@ -21,12 +21,10 @@
 #include <cmath>
 
 #include "search.h"
+#include "thread.h"
 #include "timeman.h"
 #include "uci.h"
 
-TimeManagement Time; // Our global time management object
-
-
 /// TimeManagement::init() is called at the beginning of the search and calculates
 /// the bounds of time allowed for the current game ply. We currently support:
 //      1) x basetime (+ z increment)
@@ -57,6 +55,7 @@ void TimeManagement::init(Search::LimitsType& limits, Color us, int ply) {
       limits.npmsec = npmsec;
   }
 
+  nodesAsTime = limits.npmsec;
   startTime = limits.startTime;
 
   // Maximum move horizon of 50 moves
@@ -95,3 +94,12 @@ void TimeManagement::init(Search::LimitsType& limits, Color us, int ply) {
   if (Options["Ponder"])
       optimumTime += optimumTime / 4;
 }
+
+
+/// TimeManagement::elapsed() returns the time spent on the current search, or
+/// the number of nodes searched in 'nodes as time' mode.
+
+TimePoint TimeManagement::elapsed() const {
+
+  return nodesAsTime ? TimePoint(threads.nodes_searched()) : now() - startTime;
+}
@@ -21,27 +21,28 @@
 
 #include "misc.h"
 #include "search.h"
-#include "thread.h"
+
+struct ThreadPool;
 
 /// The TimeManagement class computes the optimal time to think depending on
 /// the maximum available time, the game move number and other parameters.
 
 class TimeManagement {
 public:
+  explicit TimeManagement(const ThreadPool& tp) : threads(tp) {}
   void init(Search::LimitsType& limits, Color us, int ply);
   TimePoint optimum() const { return optimumTime; }
   TimePoint maximum() const { return maximumTime; }
-  TimePoint elapsed() const { return Search::Limits.npmsec ?
-                                     TimePoint(Threads.nodes_searched()) : now() - startTime; }
+  TimePoint elapsed() const;
 
-  int64_t availableNodes; // When in 'nodes as time' mode
+  int64_t availableNodes = 0; // When in 'nodes as time' mode
 
 private:
+  const ThreadPool& threads; // Whose nodes are counted in 'nodes as time' mode
   TimePoint startTime;
   TimePoint optimumTime;
   TimePoint maximumTime;
+  bool nodesAsTime = false;
 };
 
-extern TimeManagement Time;
-
 #endif // #ifndef TIMEMAN_H_INCLUDED
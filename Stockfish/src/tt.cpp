@@ -22,16 +22,18 @@
 
 #include "bitboard.h"
 #include "misc.h"
+#include "profiler.h"
 #include "thread.h"
 #include "tt.h"
 #include "uci.h"
 
-TranspositionTable TT; // Our global transposition table
-
 /// TTEntry::save() populates the TTEntry with a new node's data, possibly
-/// overwriting an old position. Update is not atomic and can be racy.
+/// overwriting an old position. Update is not atomic and can be racy. The
+/// generation is the one of the table the entry belongs to.
+
+void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8) {
 
-void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev) {
+  Profiler::Scope<Profiler::TT_SAVE> scope;
 
   // Preserve any existing move for the same position
   if (m || (uint16_t)k != key16)
@@ -47,7 +49,7 @@ void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev)
 
       key16     = (uint16_t)k;
       depth8    = (uint8_t)(d - DEPTH_OFFSET);
-      genBound8 = (uint8_t)(TT.generation8 | uint8_t(pv) << 2 | b);
+      genBound8 = (uint8_t)(generation8 | uint8_t(pv) << 2 | b);
       value16   = (int16_t)v;
       eval16    = (int16_t)ev;
   }
@@ -57,10 +59,9 @@ void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev)
 /// TranspositionTable::resize() sets the size of the transposition table,
 /// measured in megabytes. Transposition table consists of a power of 2 number
 /// of clusters and each cluster consists of ClusterSize number of TTEntry.
+/// The search threads using the table must be idle.
 
-void TranspositionTable::resize(size_t mbSize) {
-
-  Threads.main()->wait_for_search_finished();
+void TranspositionTable::resize(size_t mbSize, size_t threadCount) {
 
   aligned_large_pages_free(table);
 
@@ -74,29 +75,29 @@ void TranspositionTable::resize(size_t mbSize) {
       exit(EXIT_FAILURE);
   }
 
-  clear();
+  clear(threadCount);
 }
 
 
 /// TranspositionTable::clear() initializes the entire transposition table to zero,
-//  in a multi-threaded way.
+//  in a multi-threaded way, using as many threads as will search with it.
 
-void TranspositionTable::clear() {
+void TranspositionTable::clear(size_t threadCount) {
 
   std::vector<std::thread> threads;
 
-  for (size_t idx = 0; idx < Options["Threads"]; ++idx)
+  for (size_t idx = 0; idx < threadCount; ++idx)
   {
-      threads.emplace_back([this, idx]() {
+      threads.emplace_back([this, idx, threadCount]() {
 
           // Thread binding gives faster search on systems with a first-touch policy
-          if (Options["Threads"] > 8)
+          if (threadCount > 8)
               WinProcGroup::bindThisThread(idx);
 
           // Each thread will zero its part of the hash table
-          const size_t stride = size_t(clusterCount / Options["Threads"]),
+          const size_t stride = size_t(clusterCount / threadCount),
                        start  = size_t(stride * idx),
-                       len    = idx != Options["Threads"] - 1 ?
+                       len    = idx != threadCount - 1 ?
                                 stride : clusterCount - start;
 
           std::memset(&table[start], 0, len * sizeof(Cluster));
@@ -117,6 +118,8 @@ void TranspositionTable::clear() {
 
 TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
 
+  Profiler::Scope<Profiler::TT_PROBE> scope;
+
   TTEntry* const tte = first_entry(key);
   const uint16_t key16 = (uint16_t)key;  // Use the low 16 bits as key inside the cluster
 
@@ -144,6 +147,104 @@ TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
 }
 
 
+/// TranspositionTable::peek() returns the entry of the given position, if any,
+/// without refreshing its generation as probe() does.
+
+const TTEntry* TranspositionTable::peek(const Key key) const {
+
+  const TTEntry* const tte = first_entry(key);
+
+  for (int i = 0; i < ClusterSize; ++i)
+      if (tte[i].key16 == (uint16_t)key && tte[i].depth8)
+          return &tte[i];
+
+  return nullptr;
+}
+
+
+/// TranspositionTable::store() saves an entry built elsewhere, e.g. in a TTBuffer,
+/// as the search would have saved it into the table.
+
+void TranspositionTable::store(const Key key, const TTEntry& e) {
+
+  bool found;
+  probe(key, found)->save(key, e.value(), e.is_pv(), e.bound(), e.depth(), e.move(), e.eval(), generation8);
+}
+
+
+/// TTBuffer::resize() sets the number of chains of the buffer, which is then empty
+
+void TTBuffer::resize(size_t chainCount) {
+
+  assert(!(chainCount & (chainCount - 1)));
+
+  heads.assign(chainCount, 0);
+  count = 0;
+}
+
+
+/// TTBuffer::probe() looks up the current position like TranspositionTable::probe(),
+/// first in the buffer, then in the shared table, from which the entry is copied.
+/// A position not found gets an empty entry, which is saved into the table at
+/// the next write-back only if the search has filled it in by then.
+
+TTEntry* TTBuffer::probe(const TranspositionTable& tt, const Key key, bool& found) {
+
+  Profiler::Scope<Profiler::TT_PROBE> scope;
+
+  uint32_t& head = heads[chain(key)];
+
+  for (uint32_t idx = head; idx; idx = slot(idx - 1).next)
+      if (slot(idx - 1).key == key)
+          return found = (bool)slot(idx - 1).entry.depth8, &slot(idx - 1).entry;
+
+  if (count == chunks.size() * ChunkSize)
+      chunks.emplace_back(new Slot[ChunkSize]);
+
+  const TTEntry* tte = tt.peek(key);
+  Slot& s = slot(count);
+
+  s.key = key;
+  s.entry = tte ? *tte : TTEntry();
+  s.next = head;
+  head = uint32_t(++count);
+
+  return found = (tte != nullptr), &s.entry;
+}
+
+
+/// TTBuffer::write_back() saves the entries of the buffer that fall into one part
+/// of the shared table, in the order they were first probed. Each thread writes
+/// back a different part of the table from all the buffers, so the write-back
+/// is parallel but the order of the writes to each cluster is fixed.
+
+void TTBuffer::write_back(TranspositionTable& tt, size_t part, size_t partCount) const {
+
+  for (size_t idx = 0; idx < count; ++idx)
+  {
+      const Slot& s = slot(idx);
+
+      // An entry is only ever saved with the key it was probed with
+      assert(!s.entry.depth8 || s.entry.key16 == (uint16_t)s.key);
+
+      if (s.entry.depth8 && tt.cluster_index(s.key) % partCount == part)
+          tt.store(s.key, s.entry);
+  }
+}
+
+
+/// TTBuffer::clear() empties the buffer after a write-back
+
+void TTBuffer::clear() {
+
+  for (size_t idx = 0; idx < count; ++idx)
+      heads[chain(slot(idx).key)] = 0;
+
+  count = 0;
+  ++clears;
+}
+
+
 /// TranspositionTable::hashfull() returns an approximation of the hashtable
 /// occupation during a search. The hash is x permill full, as per UCI protocol.
 
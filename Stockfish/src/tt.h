@@ -19,6 +19,9 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <memory>
+#include <vector>
+
 #include "misc.h"
 #include "types.h"
 
@@ -41,10 +44,11 @@ struct TTEntry {
   Depth depth() const { return (Depth)depth8 + DEPTH_OFFSET; }
   bool is_pv()  const { return (bool)(genBound8 & 0x4); }
   Bound bound() const { return (Bound)(genBound8 & 0x3); }
-  void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev);
+  void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8);
 
 private:
   friend class TranspositionTable;
+  friend class TTBuffer;
 
   uint16_t key16;
   uint8_t  depth8;
@@ -81,23 +85,66 @@ class TranspositionTable {
 public:
  ~TranspositionTable() { aligned_large_pages_free(table); }
   void new_search() { generation8 += GENERATION_DELTA; } // Lower bits are used for other things
+  uint8_t generation() const { return generation8; }
   TTEntry* probe(const Key key, bool& found) const;
   int hashfull() const;
-  void resize(size_t mbSize);
-  void clear();
+  void resize(size_t mbSize, size_t threadCount);
+  void clear(size_t threadCount);
 
   TTEntry* first_entry(const Key key) const {
-    return &table[mul_hi64(key, clusterCount)].entry[0];
+    return &table[cluster_index(key)].entry[0];
   }
 
+  size_t cluster_index(const Key key) const { return mul_hi64(key, clusterCount); }
+  const TTEntry* peek(const Key key) const;
+  void store(const Key key, const TTEntry& e);
+
 private:
   friend struct TTEntry;
 
-  size_t clusterCount;
-  Cluster* table;
-  uint8_t generation8; // Size must be not bigger than TTEntry::genBound8
+  size_t clusterCount = 0;
+  Cluster* table = nullptr;
+  uint8_t generation8 = 0; // Size must be not bigger than TTEntry::genBound8
 };
 
-extern TranspositionTable TT;
+
+/// TTBuffer is the private view of the transposition table that a search thread
+/// uses in deterministic mode. Within an epoch the shared table is only read:
+/// the entries a thread probes are copied into its buffer, where the search
+/// updates them. Between epochs the buffers of all the threads are written back
+/// in thread order, so the shared table does not depend on the timing of the
+/// threads. The search keeps the entry of a node while it searches the children,
+/// so an entry never moves nor changes position within an epoch: the entries
+/// are appended to chunks of slots, found through chains hashed on the key. An
+/// entry kept over the end of an epoch is looked up again, see epoch().
+
+class TTBuffer {
+
+  static constexpr size_t ChunkSize = 4096;
+
+  struct Slot {
+    Key key;
+    TTEntry entry;
+    uint32_t next; // Next slot of the chain plus one, zero at the end
+  };
+
+public:
+  void resize(size_t chainCount); // Must be a power of 2
+  bool empty() const { return heads.empty(); }
+  uint64_t epoch() const { return clears; } // Changes whenever the buffer is emptied
+  TTEntry* probe(const TranspositionTable& tt, const Key key, bool& found);
+  void write_back(TranspositionTable& tt, size_t part, size_t partCount) const;
+  void clear();
+
+private:
+  // The chains use the high bits of the key, the entries keep the low ones
+  size_t chain(const Key key) const { return size_t(key >> 32) & (heads.size() - 1); }
+  Slot& slot(size_t idx) const { return chunks[idx / ChunkSize][idx % ChunkSize]; }
+
+  std::vector<uint32_t> heads; // First slot of each chain plus one, zero if empty
+  std::vector<std::unique_ptr<Slot[]>> chunks; // Kept from one epoch to the next
+  size_t count = 0;
+  uint64_t clears = 0;
+};
 
 #endif // #ifndef TT_H_INCLUDED
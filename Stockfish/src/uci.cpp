@@ -16,17 +16,27 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <numeric>
 #include <sstream>
 #include <string>
 #include <cstdlib>
 #include <vector>
 
+#include "analysis.h"
+#include "benchmark.h"
 #include "evaluate.h"
 #include "movegen.h"
+#include "packed.h"
+#include "perfcounters.h"
 #include "position.h"
+#include "profiler.h"
+#include "engine.h"
 #include "search.h"
 #include "thread.h"
 #include "timeman.h"
@@ -37,7 +47,6 @@
 
 using namespace std;
 
-extern vector<string> setup_bench(const Position&, istream&);
 
 namespace {
 
@@ -50,7 +59,7 @@ namespace {
   // or the starting position ("startpos") and then makes the moves given in the
   // following move list ("moves").
 
-  void position(Position& pos, istringstream& is, StateListPtr& states) {
+  void position(Engine& engine, Position& pos, istringstream& is, StateListPtr& states) {
 
     Move m;
     string token, fen;
@@ -69,7 +78,7 @@ namespace {
         return;
 
     states = StateListPtr(new std::deque<StateInfo>(1)); // Drop old and create a new one
-    pos.set(fen, Options["UCI_Chess960"], &states->back(), Threads.main());
+    pos.set(fen, Options["UCI_Chess960"], &states->back(), engine.threads.main());
 
     // Parse move list (if any)
     while (is >> token && (m = UCI::to_move(pos, token)) != MOVE_NONE)
@@ -82,14 +91,13 @@ namespace {
   // trace_eval() prints the evaluation for the current position, consistent with the UCI
   // options set so far.
 
-/* NOT USED:
-  void trace_eval(Position& pos) {
+  void trace_eval(Engine& engine, Position& pos) {
 
     StateListPtr states(new std::deque<StateInfo>(1));
     Position p;
-    p.set(pos.fen(), Options["UCI_Chess960"], &states->back(), Threads.main());
+    p.set(pos.fen(), Options["UCI_Chess960"], &states->back(), engine.threads.main());
 
-    Eval::NNUE::verify();
+    Eval::NNUE::verify(Eval::NNUE::active_net());
 
     sync_cout << "\n" << Eval::trace(p) << sync_endl;
   }
@@ -113,26 +121,57 @@ namespace {
     while (is >> token)
         value += (value.empty() ? "" : " ") + token;
 
-    if (Options.count(name)){
+    if (Options.count(name))
         Options[name] = value;
-        std::cout<<Options[name]<<std::endl;
-    }else{
+    else
         sync_cout << "No such option: " << name << sync_endl;
-      }
   }
-*/
 
-  // go() is called when engine receives the "go" UCI command. The function sets
-  // the thinking time and other parameters from the input string, then starts
-  // the search.
+  // net() is called when engine receives the "net" command. "net load <file>"
+  // loads a network in the background and makes it active once read, "net use
+  // <name>" switches to an already resident network, "net unload <name>" frees
+  // one and "net" alone lists them, the active one marked with a star.
 
-  void go(Position& pos, istringstream& is, StateListPtr& states) {
+  void net(istringstream& is) {
 
-    Search::LimitsType limits;
-    string token;
-    bool ponderMode = false;
+    string token, name;
+    is >> token >> name;
 
-    limits.startTime = now(); // As early as possible!
+    if (token == "load")
+        Eval::NNUE::load_async(name);
+
+    else if (token == "use" && !Eval::NNUE::select_net(name))
+        sync_cout << "Network not loaded: " << name << sync_endl;
+
+    else if (token == "unload" && !Eval::NNUE::unload_net(name))
+        sync_cout << "Network not loaded or in use: " << name << sync_endl;
+
+    else if (token.empty() || token == "list")
+    {
+        Eval::NNUE::NetPtr active = Eval::NNUE::active_net();
+        for (const string& n : Eval::NNUE::resident_nets())
+            sync_cout << (active && Eval::NNUE::find_net(n) == active ? "* " : "  ") << n << sync_endl;
+    }
+  }
+
+  // new_game() is called when engine receives the "ucinewgame" UCI command. It
+  // resets the search state and also frees the mapped tablebase files, which
+  // are shared by all the engines of the process.
+
+  void new_game(Engine& engine) {
+
+    engine.clear();
+    Tablebases::init(Options["SyzygyPath"]); // Free mapped files
+  }
+
+
+  // parse_limits() reads the search limits of a "go" command from the input
+  // string, 'pos' is needed only to decode the "searchmoves". Returns false,
+  // after an error message, if the limits name a network which is not loaded.
+
+  bool parse_limits(const Position& pos, istream& is, Search::LimitsType& limits, bool& ponderMode) {
+
+    string token;
 
     while (is >> token)
         if (token == "searchmoves") // Needs to be the last command on the line
@@ -149,10 +188,33 @@ namespace {
         else if (token == "movetime")  is >> limits.movetime;
         else if (token == "mate")      is >> limits.mate;
         else if (token == "perft")     is >> limits.perft;
+        else if (token == "net")       is >> limits.net;
         else if (token == "infinite")  limits.infinite = 1;
         else if (token == "ponder")    ponderMode = true;
 
-    Threads.start_thinking(pos, states, limits, ponderMode);
+    if (!limits.net.empty() && !Eval::NNUE::find_net(limits.net))
+    {
+        sync_cout << "info string ERROR: network not loaded: " << limits.net << sync_endl;
+        return false;
+    }
+
+    return true;
+  }
+
+
+  // go() is called when engine receives the "go" UCI command. The function sets
+  // the thinking time and other parameters from the input string, then starts
+  // the search.
+
+  void go(Engine& engine, Position& pos, istringstream& is, StateListPtr& states) {
+
+    Search::LimitsType limits;
+    bool ponderMode = false;
+
+    limits.startTime = now(); // As early as possible!
+
+    if (parse_limits(pos, is, limits, ponderMode))
+        engine.threads.start_thinking(pos, states, limits, ponderMode);
     //std::cout<<pos<<std::endl;
   }
 
@@ -161,11 +223,14 @@ namespace {
   // a list of UCI commands is setup according to bench parameters, then
   // it is run one by one printing a summary at the end.
 
-/* NOT USED:
-  void bench(Position& pos, istream& args, StateListPtr& states) {
+  void bench(Engine& engine, Position& pos, istream& args, StateListPtr& states) {
 
     string token;
     uint64_t num, nodes = 0, cnt = 1;
+    uint64_t refreshes = 0, updates = 0, ecProbes = 0, ecHits = 0;
+    int64_t latency = 0, searches = 0;
+    vector<Perf::Counts> perf;          // Hardware counts of each thread, and the
+    vector<uint64_t> perfNodes, perfEvals; // nodes and evaluations they were spent on
 
     vector<string> list = setup_bench(pos, args);
     num = count_if(list.begin(), list.end(), [](string s) { return s.find("go ") == 0 || s.find("eval") == 0; });
@@ -182,16 +247,36 @@ namespace {
             cerr << "\nPosition: " << cnt++ << '/' << num << " (" << pos.fen() << ")" << endl;
             if (token == "go")
             {
-               go(pos, is, states);
-               Threads.main()->wait_for_search_finished();
-               nodes += Threads.nodes_searched();
+               go(engine, pos, is, states);
+               engine.threads.main()->wait_for_search_finished();
+               nodes += engine.threads.nodes_searched();
+               refreshes += engine.threads.nnue_refreshes();
+               updates += engine.threads.nnue_updates();
+               ecProbes += engine.threads.eval_cache_probes();
+               ecHits += engine.threads.eval_cache_hits();
+               latency += engine.threads.first_node_latency();
+               ++searches;
+
+               if (engine.threads.perfCounters)
+               {
+                   size_t n = std::max(perf.size(), engine.threads.size());
+                   perf.resize(n), perfNodes.resize(n), perfEvals.resize(n);
+
+                   for (size_t i = 0; i < engine.threads.size(); ++i)
+                   {
+                       Thread* th = engine.threads[i];
+                       perf[i] += th->perfCounts;
+                       perfNodes[i] += th->nodes;
+                       perfEvals[i] += th->evaluations;
+                   }
+               }
             }
             else
-               trace_eval(pos);
+               trace_eval(engine, pos);
         }
         else if (token == "setoption")  setoption(is);
-        else if (token == "position")   position(pos, is, states);
-        else if (token == "ucinewgame") { Search::clear(); elapsed = now(); } // Search::clear() may take some while
+        else if (token == "position")   position(engine, pos, is, states);
+        else if (token == "ucinewgame") { new_game(engine); elapsed = now(); } // new_game() may take some while
     }
 
     elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
@@ -201,9 +286,423 @@ namespace {
     cerr << "\n==========================="
          << "\nTotal time (ms) : " << elapsed
          << "\nNodes searched  : " << nodes
-         << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+         << "\nNodes/second    : " << 1000 * nodes / elapsed
+         << "\nNNUE refreshes  : " << refreshes
+         << "\nNNUE updates    : " << updates
+         << "\nEval cache hits : " << ecHits << " of " << ecProbes << " probes ("
+         << std::fixed << std::setprecision(2) << 100.0 * ecHits / std::max(ecProbes, uint64_t(1))
+         << "%)" << std::defaultfloat
+         << "\nGo to first node: " << latency / std::max(searches, int64_t(1)) << " us average"
+         << endl;
+
+    if (perf.empty())
+        return;
+
+    // Hardware counts per node and per evaluation, evaluations being the calls
+    // of Eval::evaluate(), whatever the eval cache and the deterministic mode.
+    Perf::Counts total;
+    uint64_t totalNodes = 0, totalEvals = 0;
+
+    for (size_t i = 0; i < perf.size(); ++i)
+        total += perf[i], totalNodes += perfNodes[i], totalEvals += perfEvals[i];
+
+    if (!total.any())
+    {
+        cerr << "\nHardware counters are not available" << endl;
+        return;
+    }
+
+    cerr << "\n" << Perf::header("Hardware counts");
+
+    for (size_t i = 0; i < perf.size(); ++i)
+        cerr << Perf::row("thread " + to_string(i) + " /node", perf[i], double(perfNodes[i]))
+             << Perf::row("thread " + to_string(i) + " /eval", perf[i], double(perfEvals[i]));
+
+    cerr << Perf::row("all /node", total, double(totalNodes))
+         << Perf::row("all /eval", total, double(totalEvals)) << endl;
+  }
+
+
+  // bench_report() is called when engine receives the "benchreport" command,
+  // e.g. "benchreport runs 5 baseline base.json 16 1 13 default depth". It runs
+  // the bench several times with silent searches and prints a JSON report, or
+  // writes it to the file given with "output". The parameters that follow the
+  // named ones are those of bench. Given the report of a baseline, it returns
+  // false on a significant slowdown larger than "threshold" percent (1 default).
+
+  bool bench_report(Engine& engine, Position& pos, istringstream& is, StateListPtr& states) {
+
+    Bench::Report report;
+    Bench::Comparison comparison;
+    vector<double> baseline;
+    string token, baselineFile, outputFile;
+    int runs = 5;
+    double threshold = 1.0;
+
+    for (streampos p = is.tellg(); is >> token; p = is.tellg())
+        if (token == "runs")           is >> runs;
+        else if (token == "baseline")  is >> baselineFile;
+        else if (token == "output")    is >> outputFile;
+        else if (token == "threshold") is >> threshold;
+        else
+        {
+            is.seekg(p); // Back to the first parameter of bench
+            break;
+        }
+
+    getline(is >> ws, report.settings);
+
+    if (!baselineFile.empty() && !Bench::read_baseline(baselineFile, baseline))
+    {
+        sync_cout << "Unable to read the baseline " << baselineFile << sync_endl;
+        return false;
+    }
+
+    istringstream args(report.settings);
+    vector<string> list = setup_bench(pos, args);
+
+    for (int run = 1; run <= std::max(runs, 1); ++run)
+    {
+        uint64_t nodes = 0;
+        int64_t time = 0;
+        size_t cnt = 0;
+
+        cerr << "Run " << run << '/' << std::max(runs, 1) << endl;
+
+        for (const auto& cmd : list)
+        {
+            istringstream cs(cmd);
+            cs >> skipws >> token;
+
+            if (token == "go")
+            {
+                Search::LimitsType limits;
+                bool ponderMode = false;
+
+                limits.startTime = now();
+                limits.silent = true;
+                if (!parse_limits(pos, cs, limits, ponderMode))
+                    return false;
+
+                int64_t start = now_us();
+                engine.threads.start_thinking(pos, states, limits);
+                engine.threads.main()->wait_for_search_finished();
+
+                Bench::Sample s = { engine.threads.nodes_searched(), now_us() - start,
+                                    engine.threads.main()->bestThread->completedDepth,
+                                    engine.tt.hashfull() };
+
+                if (cnt == report.records.size())
+                    report.records.push_back({ pos.fen(), Options["Use NNUE"] ? "NNUE" : "classical", {} });
+
+                report.records[cnt++].samples.push_back(s);
+                nodes += s.nodes;
+                time += s.timeUs;
+            }
+            else if (token == "setoption")  setoption(cs);
+            else if (token == "position")   position(engine, pos, cs, states);
+            else if (token == "ucinewgame") new_game(engine);
+        }
+
+        report.runNps.push_back(1e6 * nodes / std::max(time, int64_t(1)));
+    }
+
+    if (!baselineFile.empty())
+    {
+        comparison = Bench::compare(baseline, report.runNps, threshold);
+
+        cerr << "Nodes/second change against the baseline: "
+             << std::fixed << std::setprecision(2) << comparison.change << "%"
+             << (comparison.slowdown ? ", a significant slowdown" : "") << std::defaultfloat << endl;
+    }
+
+    string json = Bench::to_json(report, baselineFile.empty() ? nullptr : &comparison, baselineFile);
+
+    if (outputFile.empty())
+        sync_cout << json << sync_endl;
+    else
+    {
+        ofstream file(outputFile);
+
+        if (!(file << json << endl))
+            sync_cout << "Unable to write " << outputFile << sync_endl;
+    }
+
+    return baselineFile.empty() || !comparison.slowdown;
+  }
+
+
+  // perft() is called when engine receives the "perft" command, e.g. "perft 6"
+  // on the current position or "perft 5 fen <fen>" (or "startpos"). It counts
+  // the leaf nodes of the move generator with all the search threads.
+
+  void perft(Engine& engine, const Position& pos, istringstream& is) {
+
+    Search::LimitsType limits;
+    StateListPtr states(new std::deque<StateInfo>(1));
+    Position p;
+    string token, fen = pos.fen();
+
+    is >> limits.perft >> token;
+
+    if (token == "startpos")
+        fen = StartFEN;
+    else if (token == "fen")
+        for (fen.clear(); is >> token; )
+            fen += token + " ";
+
+    if (limits.perft <= 0)
+    {
+        sync_cout << "Usage: perft <depth> [startpos | fen <fen>]" << sync_endl;
+        return;
+    }
+
+    limits.startTime = now();
+    p.set(fen, Options["UCI_Chess960"], &states->back(), engine.threads.main());
+    engine.threads.start_thinking(p, states, limits);
+    engine.threads.main()->wait_for_search_finished();
+  }
+
+
+  // analyse_epd() is called when engine receives the "analyse-epd" command, e.g.
+  // "analyse-epd positions.epd workers 8 threads 1 hash private format json depth 16".
+  // Every position of the file is searched on its own with the "go" limits that
+  // follow the options. There are 'Threads' single-threaded workers by default.
+
+  void analyse_epd(Engine& engine, const Position& pos, istringstream& is) {
+
+    Analysis::Config config;
+    Search::LimitsType limits;
+    string fileName, token, goLimits;
+    bool ponderMode = false;
+
+    config.workers = size_t(Options["Threads"]);
+    is >> fileName;
+
+    while (is >> token)
+        if (token == "workers")      is >> config.workers;
+        else if (token == "threads") is >> config.threads;
+        else if (token == "hash")    config.sharedTT = is >> token && token == "shared";
+        else if (token == "reset")   config.age = is >> token && token == "age";
+        else if (token == "format")  config.json = is >> token && token == "json";
+        else if (token == "packed")  is >> config.packedFile;
+        else                         goLimits += token + " ";
+
+    istringstream ls(goLimits);
+
+    if (!parse_limits(pos, ls, limits, ponderMode))
+        return;
+
+    if (!limits.depth && !limits.nodes && !limits.movetime)
+        sync_cout << "analyse-epd needs a depth, nodes or movetime limit" << sync_endl;
+
+    else if (fileName.empty() || !config.workers || !config.threads)
+        sync_cout << "Usage: analyse-epd <file> [workers <n>] [threads <n>] [hash private|shared] "
+                     "[reset clear|age] [format epd|json] [packed <file>] <limits>" << sync_endl;
+    else
+        Analysis::analyse_epd(engine, fileName, limits, config);
+  }
+
+
+  // solve() is called when engine receives the "solve" command, e.g. "solve
+  // wac.epd movetime 1000". It searches the positions of an EPD test suite with
+  // the "go" limits that follow the file name, and reports how many of them are
+  // solved and how fast, see Analysis::solve().
+
+  void solve(Engine& engine, const Position& pos, istringstream& is) {
+
+    Search::LimitsType limits;
+    string fileName;
+    bool ponderMode = false;
+
+    is >> fileName;
+
+    if (!parse_limits(pos, is, limits, ponderMode))
+        return;
+
+    if (fileName.empty() || (!limits.depth && !limits.nodes && !limits.movetime))
+        sync_cout << "Usage: solve <file> <depth, nodes or movetime limit>" << sync_endl;
+    else
+        Analysis::solve(engine, fileName, limits);
+  }
+
+
+  // convert() is called when engine receives the "convert" command, e.g. "convert
+  // games.bin games.epd". It converts a file of positions between FEN or EPD
+  // lines and packed records, the packed files being those named *.bin, see
+  // Packed::convert().
+
+  bool convert(istringstream& is) {
+
+    string from, to;
+
+    if (!(is >> from >> to))
+    {
+        sync_cout << "Usage: convert <from file> <to file>" << sync_endl;
+        return false;
+    }
+
+    return Packed::convert(from, to, Options["UCI_Chess960"]);
+  }
+
+
+  // save_game() is called when engine receives the "savegame" command, e.g.
+  // "savegame games.bin". It appends the positions of the game played from the
+  // start position to a packed file, with the moves played. The result is
+  // recorded if the game ended in a mate or a stalemate.
+
+  bool save_game(Engine& engine, const vector<string>& moves, istringstream& is) {
+
+    StateListPtr states(new std::deque<StateInfo>(1));
+    vector<Packed::Record> records;
+    Position pos;
+    string fileName;
+
+    if (!(is >> fileName))
+    {
+        sync_cout << "Usage: savegame <file>" << sync_endl;
+        return false;
+    }
+
+    Packed::Writer writer(fileName, true);
+
+    if (!writer.is_open())
+    {
+        sync_cout << "Unable to open file " << fileName << sync_endl;
+        return false;
+    }
+
+    pos.set(StartFEN, false, &states->back(), engine.threads.main());
+
+    for (string token : moves)
+    {
+        Move m = UCI::to_move(pos, token);
+
+        records.push_back(Packed::record(pos));
+        records.back().move = uint16_t(m);
+        states->emplace_back();
+        pos.do_move(m, states->back());
+    }
+
+    records.push_back(Packed::record(pos));
+
+    // The side to move of the last position lost if mated, and the sides
+    // alternate from the end.
+    if (!MoveList<LEGAL>(pos).size())
+        for (size_t i = 0; i < records.size(); ++i)
+            records[i].result = int8_t(!pos.checkers() ? 0 : (records.size() - 1 - i) % 2 ? 1 : -1);
+
+    for (const Packed::Record& r : records)
+        writer.write(r);
+
+    sync_cout << "Saved " << records.size() << " positions to " << fileName << sync_endl;
+    return true;
+  }
+
+
+  // search_stats() is called when engine receives the "searchstats" command, e.g.
+  // "searchstats json". It prints the search statistics summed over all threads
+  // and searches since the last "searchstats", and starts counting afresh.
+
+  void search_stats(Engine& engine, istringstream& is) {
+
+    string format;
+    is >> format;
+
+    engine.threads.main()->wait_for_search_finished();
+    sync_cout << SearchStats::report(engine.threads.searchStats, format == "json") << sync_endl;
+    engine.threads.searchStats.clear();
+  }
+
+
+  // profile() is called when engine receives the "profile" command, e.g.
+  // "profile phases.folded". It prints, or writes to the given file, the time
+  // spent in the search phases summed over all threads and searches since the
+  // last "profile", as folded stacks for flamegraph tools, and starts afresh.
+
+  void profile(Engine& engine, istringstream& is) {
+
+    string fileName;
+    is >> fileName;
+
+    engine.threads.main()->wait_for_search_finished();
+
+    if (fileName.empty())
+        sync_cout << Profiler::report(engine.threads.profile) << sync_endl;
+    else
+    {
+        ofstream file(fileName);
+
+        if (!(file << Profiler::report(engine.threads.profile)))
+            sync_cout << "Unable to write " << fileName << sync_endl;
+    }
+
+    engine.threads.profile.clear();
+  }
+
+
+  // thread_bench() is called when engine receives the "threadbench" command, e.g.
+  // "threadbench 200 1 8 64 256". For each number of threads it times the round
+  // trip of a "go depth 1" on the start position, from waking up the threads to
+  // having them all parked again, which is the overhead of a micro-search.
+
+  void thread_bench(istringstream& is) {
+
+    int iterations = 200;
+    vector<size_t> threadCounts;
+    string token;
+    bool valid = true;
+
+    if (is >> token)
+        valid = (iterations = atoi(token.c_str())) >= 1;
+
+    while (valid && is >> token)
+    {
+        int n = atoi(token.c_str());
+        valid = n >= 1;
+        threadCounts.push_back(size_t(n));
+    }
+
+    if (!valid)
+    {
+        sync_cout << "Usage: threadbench [<iterations> [<threads> ...]]" << sync_endl;
+        return;
+    }
+
+    if (threadCounts.empty())
+        threadCounts = { 1, 8, 64, 256 };
+
+    for (size_t threads : threadCounts)
+    {
+        Engine engine(threads, 16, 0);
+        Search::LimitsType limits;
+        Position pos;
+        vector<int64_t> elapsed;
+
+        limits.depth = 1;
+        limits.silent = true;
+
+        while (int(elapsed.size()) < iterations)
+        {
+            StateListPtr states(new std::deque<StateInfo>(1));
+            pos.set(StartFEN, false, &states->back(), engine.threads.main());
+            limits.startTime = now();
+
+            int64_t start = now_us();
+            engine.threads.start_thinking(pos, states, limits);
+            engine.threads.main()->wait_for_search_finished();
+            elapsed.push_back(now_us() - start);
+        }
+
+        std::sort(elapsed.begin(), elapsed.end());
+
+        sync_cout << "Threads " << setw(4) << threads
+                  << "  go/stop round trip (us): best " << setw(8) << elapsed.front()
+                  << "  median " << setw(8) << elapsed[elapsed.size() / 2]
+                  << "  average " << setw(8) << std::accumulate(elapsed.begin(), elapsed.end(), int64_t(0)) / int64_t(elapsed.size())
+                  << sync_endl;
+    }
   }
-*/
 
 
   // The win rate model returns the probability (per mille) of winning given an eval
@@ -329,7 +828,7 @@ void pieceRaisingOutput(string PGN, vector<string> PGN_vec){
           }
 }
 
-void UCI::ChessboardLoop(int argc, char* argv[]){
+int UCI::ChessboardLoop(Engine& engine, int argc, char* argv[]){
   // Waits for a command from stdin, parses it and does the appropriate operation. 
   // Modified from UCI::loop in original code. 
 
@@ -340,8 +839,10 @@ void UCI::ChessboardLoop(int argc, char* argv[]){
   vector<string> PGN_vec;
   string PGN_command = "startpos moves ";
   StateListPtr states(new std::deque<StateInfo>(1));
+  int status = EXIT_SUCCESS; // Set by the commands that can fail, e.g. benchreport
 
-  pos.set(StartFEN, false, &states->back(), Threads.main());
+  CurrentEngine = &engine; // The one changed by setoption
+  pos.set(StartFEN, false, &states->back(), engine.threads.main());
 
   // Parsing
   for (int i = 1; i < argc; ++i){
@@ -363,12 +864,12 @@ void UCI::ChessboardLoop(int argc, char* argv[]){
 // Operations based on inputs:
         if (token == "quit" || token == "stop"){
           // Quit
-          Threads.stop = true;
+          engine.threads.stop = true;
 
         }else if (token == "printposition"){
           // Prints current position
           istringstream is_2(PGN_command);
-          position(pos, is_2, states);
+          position(engine, pos, is_2, states);
           std::cout<<pos<<std::endl;
 
         }else if (token == "move"){
@@ -398,7 +899,7 @@ void UCI::ChessboardLoop(int argc, char* argv[]){
             }else{
               // The move is a legal move
               istringstream is_2(PGN_command);
-              position(pos, is_2, states);
+              position(engine, pos, is_2, states);
               std::cout<<pos<<std::endl;
 
               std::cout<<"PGN vector: ";
@@ -416,7 +917,7 @@ void UCI::ChessboardLoop(int argc, char* argv[]){
         }else if (token == "bestmove"){
           // Outputs depth 22 best computer move
           istringstream is_2("go depth 22");
-          go(pos, is_2, states);
+          go(engine, pos, is_2, states);
 
         }else if (token == "removelastmove"){
           // Removes last move
@@ -431,6 +932,70 @@ void UCI::ChessboardLoop(int argc, char* argv[]){
           // Piece raising output visualization
           pieceRaisingOutput(PGN, PGN_vec);
 
+        }else if (token == "setoption"){
+          // Sets an engine option, e.g. "setoption name Eval Cache value 16"
+          setoption(is);
+
+        }else if (token == "net"){
+          // Lists, loads or switches NNUE networks, see net()
+          net(is);
+
+        }else if (token == "bench"){
+          // Runs the built-in benchmark, see setup_bench() for the parameters
+          bench(engine, pos, is, states);
+
+        }else if (token == "benchreport"){
+          // Runs the bench several times and reports in JSON, see bench_report()
+          if (!bench_report(engine, pos, is, states))
+            status = EXIT_FAILURE;
+
+        }else if (token == "perft"){
+          // Counts the leaf nodes of the move generator, see perft()
+          perft(engine, pos, is);
+
+        }else if (token == "analyse-epd"){
+          // Searches all the positions of an EPD file, see analyse_epd()
+          analyse_epd(engine, pos, is);
+
+        }else if (token == "solve"){
+          // Measures the time to solution of an EPD test suite, see solve()
+          solve(engine, pos, is);
+
+        }else if (token == "convert"){
+          // Converts positions between text and packed files, see convert()
+          if (!convert(is))
+            status = EXIT_FAILURE;
+
+        }else if (token == "savegame"){
+          // Appends the game to a packed file, see save_game()
+          if (!save_game(engine, PGN_vec, is))
+            status = EXIT_FAILURE;
+
+        }else if (token == "microbench"){
+          // Times the hot components of the search, e.g. "microbench 100 5" for
+          // five samples of 100 ms each, see Bench::microbench()
+          int sampleMs = 100, samples = 5;
+          is >> sampleMs >> samples;
+          Bench::microbench(sampleMs, samples);
+
+        }else if (token == "threadbench"){
+          // Times the wake up and parking of the search threads, see thread_bench()
+          thread_bench(is);
+
+        }else if (token == "profile"){
+          // Prints the phase profile of a phases=yes build, see profile()
+          profile(engine, is);
+
+        }else if (token == "outputstats"){
+          // Counts the messages of the output queue, see start_output()
+          OutputStats o = output_stats();
+          sync_cout << "Output messages: " << o.messages << ", coalesced: " << o.coalesced
+                    << ", dropped: " << o.dropped << ", waits for room: " << o.waits << sync_endl;
+
+        }else if (token == "searchstats"){
+          // Prints the search statistics of a stats=yes build, see search_stats()
+          search_stats(engine, is);
+
         }else if (token == "getPGN"){
           std::cout<<"PGN vector: ";
               for (int i = 0; i < int(PGN_vec.size()); i++){
@@ -446,20 +1011,20 @@ void UCI::ChessboardLoop(int argc, char* argv[]){
 
   } while (token != "quit" && argc == 1);
 
-
+  return status;
 }
 
 //              |-------------------------------------------------------------------|
 
 
 /*
-void UCI::loop(int argc, char* argv[]) {
+void UCI::loop(Engine& engine, int argc, char* argv[]) {
 
   Position pos;
   string token, cmd;
   StateListPtr states(new std::deque<StateInfo>(1));
 
-  pos.set(StartFEN, false, &states->back(), Threads.main());
+  pos.set(StartFEN, false, &states->back(), engine.threads.main());
 
   for (int i = 1; i < argc; ++i)
       cmd += std::string(argv[i]) + " ";
@@ -476,14 +1041,14 @@ void UCI::loop(int argc, char* argv[]) {
       
       if (    token == "quit"
           ||  token == "stop")
-          Threads.stop = true;
+          engine.threads.stop = true;
 
       // The GUI sends 'ponderhit' to tell us the user has played the expected move.
       // So 'ponderhit' will be sent if we were told to ponder on the same move the
       // user has played. We should continue searching but switch from pondering to
       // normal search.
       else if (token == "ponderhit")
-          Threads.main()->ponder = false; // Switch to normal search
+          engine.threads.main()->ponder = false; // Switch to normal search
 
       else if (token == "uci")
           sync_cout << "id name " << engine_info(true)
@@ -491,17 +1056,17 @@ void UCI::loop(int argc, char* argv[]) {
                     << "\nuciok"  << sync_endl;
 
       else if (token == "setoption")  setoption(is);
-      else if (token == "go")         go(pos, is, states);
-      else if (token == "position")   position(pos, is, states);
-      else if (token == "ucinewgame") Search::clear();
+      else if (token == "go")         go(engine, pos, is, states);
+      else if (token == "position")   position(engine, pos, is, states);
+      else if (token == "ucinewgame") new_game(engine);
       else if (token == "isready")    sync_cout << "readyok" << sync_endl;
 
       // Additional custom non-UCI commands, mainly for debugging.
       // Do not use these commands during a search!
       else if (token == "flip")     pos.flip();
-      else if (token == "bench")    bench(pos, is, states);
+      else if (token == "bench")    bench(engine, pos, is, states);
       else if (token == "d")        sync_cout << pos << sync_endl;
-      else if (token == "eval")     trace_eval(pos);
+      else if (token == "eval")     trace_eval(engine, pos);
       else if (token == "compiler") sync_cout << compiler_info() << sync_endl;
       else
           sync_cout << "Unknown command: " << cmd << sync_endl;
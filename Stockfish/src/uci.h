@@ -24,6 +24,7 @@
 
 #include "types.h"
 
+class Engine;
 class Position;
 
 namespace UCI {
@@ -66,9 +67,11 @@ private:
   OnChange on_change;
 };
 
+extern Engine* CurrentEngine;
+
 void init(OptionsMap&);
-//void loop(int argc, char* argv[]);
-void ChessboardLoop(int argc, char* argv[]);
+//void loop(Engine& engine, int argc, char* argv[]);
+int ChessboardLoop(Engine& engine, int argc, char* argv[]);
 std::string value(Value v);
 std::string square(Square s);
 std::string move(Move m, bool chess960);
@@ -21,6 +21,7 @@
 #include <ostream>
 #include <sstream>
 
+#include "engine.h"
 #include "evaluate.h"
 #include "misc.h"
 #include "search.h"
@@ -35,14 +36,18 @@ UCI::OptionsMap Options; // Global object
 
 namespace UCI {
 
+/// The engine driven by the UCI loop, which the options below act upon
+Engine* CurrentEngine;
+
 /// 'On change' actions, triggered by an option's value change
-void on_clear_hash(const Option&) { Search::clear(); }
-void on_hash_size(const Option& o) { TT.resize(size_t(o)); }
+void on_clear_hash(const Option&) { CurrentEngine->clear(); }
+void on_hash_size(const Option& o) { CurrentEngine->resize_tt(size_t(o)); }
+void on_eval_cache_size(const Option& o) { CurrentEngine->resize_eval_cache(size_t(o)); }
 void on_logger(const Option& o) { start_logger(o); }
-void on_threads(const Option& o) { Threads.set(size_t(o)); }
+void on_threads(const Option& o) { CurrentEngine->set_threads(size_t(o)); }
 void on_tb_path(const Option& o) { Tablebases::init(o); }
 void on_use_NNUE(const Option& ) { Eval::NNUE::init(); }
-void on_eval_file(const Option& ) { Eval::NNUE::init(); }
+void on_eval_file(const Option& o) { if (Eval::useNNUE) Eval::NNUE::load_async(std::string(o)); }
 
 /// Our case insensitive less() function as required by UCI protocol
 bool CaseInsensitiveLess::operator() (const string& s1, const string& s2) const {
@@ -59,13 +64,20 @@ void init(OptionsMap& o) {
   constexpr int MaxHashMB = Is64Bit ? 33554432 : 2048;
 
   o["Debug Log File"]        << Option("", on_logger);
+  o["Perf Counters"]         << Option(false);
+  o["Telemetry Interval"]    << Option(0, 0, 3600000);
+  o["Telemetry File"]        << Option("");
   o["Contempt"]              << Option(24, -100, 100);
   o["Analysis Contempt"]     << Option("Both var Off var White var Black var Both", "Both");
   o["Threads"]               << Option(1, 1, 512, on_threads);
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
   o["Clear Hash"]            << Option(on_clear_hash);
+  o["Eval Cache"]            << Option(4, 0, 1024, on_eval_cache_size);
+  o["Deterministic"]         << Option(false);
+  o["SMP Mode"]              << Option("Lazy var Lazy var ABDADA", "Lazy");
   o["Ponder"]                << Option(false);
   o["MultiPV"]               << Option(1, 1, 500);
+  o["Parallel MultiPV"]      << Option(false);
   o["Skill Level"]           << Option(20, 0, 20);
   o["Move Overhead"]         << Option(10, 0, 5000);
   o["Slow Mover"]            << Option(100, 10, 1000);
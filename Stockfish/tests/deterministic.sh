@@ -0,0 +1,35 @@
+#!/bin/bash
+# verify reproducible multi-threaded search with the Deterministic option
+
+error()
+{
+  echo "deterministic testing failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+echo "deterministic testing started"
+
+# run the same bench twice with several threads, once with a depth limit
+# and once with a node limit. The best moves and the node counts of both
+# runs should be identical. Debug builds also check, at each write-back,
+# that every buffered entry was saved under the key it was probed with,
+# and abort before the node count is printed otherwise.
+run()
+{
+  printf "setoption name Deterministic value true\nbench 16 4 $1 default $2\nquit\n" \
+    | ./stockfish 2>&1 | grep -E "^bestmove|Nodes searched"
+}
+
+for limit in "10 depth" "100000 nodes"
+do
+
+  echo "deterministic testing with $limit"
+
+  first=$(run $limit)
+  second=$(run $limit)
+  echo "$first" | grep -q "Nodes searched" && [ "$first" = "$second" ]
+
+done
+
+echo "deterministic testing OK"
@@ -0,0 +1,96 @@
+#!/bin/bash
+# verify the packed positions: conversions, saved games and batch analysis
+
+error()
+{
+  echo "packed testing failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+echo "packed testing started"
+
+# castling, en passant, Chess960, promoted pieces and large move counters
+cat << EOF > packed.epd
+rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1
+r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1
+8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1
+r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1
+rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8
+rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3
+bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9
+2nnrbkr/p1qppppp/8/1ppb4/6PP/3PP3/PPP2P2/BQNNRBKR w HEhe - 1 9
+QQQQ4/8/8/8/k7/7K/8/qqqq4 b - - 99 200
+EOF
+
+cat << EOF > packed.cmd
+setoption name UCI_Chess960 value true
+convert packed.epd packed.txt
+convert packed.epd packed.bin
+convert packed.bin packed.out
+setoption name UCI_Chess960 value false
+setoption name Use NNUE value false
+move f2f3
+move e7e5
+move g2g4
+move d8h4
+savegame game.bin
+convert game.bin game.epd
+analyse-epd game.bin packed analysed.bin depth 4
+convert analysed.bin analysed.epd
+quit
+EOF
+
+./stockfish < packed.cmd > packed.log 2>&1
+
+# records of random bytes, the valid records and a copy of them with a byte
+# overwritten in each
+head -c 40000 /dev/urandom > random.bin
+cp packed.bin corrupt.bin
+for offset in 0 41 82 123 164 205 246 287 328; do
+  printf '\377' | dd of=corrupt.bin bs=1 seek=$offset conv=notrunc 2> /dev/null
+done
+cat packed.bin corrupt.bin >> random.bin
+
+cat << EOF > random.cmd
+setoption name Use NNUE value false
+convert random.bin random.epd
+convert random.bin random.out.bin
+analyse-epd random.bin depth 1
+quit
+EOF
+
+./stockfish < random.cmd > random.log 2>&1
+
+# the positions are the same through their packed records
+[ "$(stat -c %s packed.bin)" = 360 ]
+diff packed.txt packed.out
+
+# a file is not converted to itself, which would truncate it
+! ./stockfish convert packed.bin ./packed.bin > self.log 2>&1
+grep -q "Cannot convert packed.bin to itself" self.log
+[ "$(stat -c %s packed.bin)" = 360 ]
+
+# the game, with its moves, and the analysis of its positions
+[ "$(stat -c %s game.bin)" = 200 ]
+[ "$(grep -c ' pm ' game.epd)" = 4 ]
+[ "$(od -An -tx1 -j197 -N1 game.bin | tr -d ' ')" = ff ] # white is mated
+[ "$(od -An -tx1 -j77 -N1 game.bin | tr -d ' ')" = 01 ]
+grep -q "^rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3$" game.epd
+[ "$(grep -c 'acd 4;' analysed.epd)" = 4 ]
+grep -q "^rnbqkbnr/pppp1ppp/8/4p3/6P1/5P2/PPPPP2P/RNBQKBNR b KQkq - 0 2 pm d8h4; dm 1; acd 4;$" analysed.epd
+
+# the records which are not valid positions are skipped, and only them
+converted=$(grep -m1 "^Converted .* from random.bin" random.log | cut -d' ' -f2)
+skipped=$(grep -m1 "^Skipped .* of random.bin" random.log | cut -d' ' -f2)
+[ "$converted" -ge 9 ] && [ "$skipped" -ge 1000 ]
+[ $((converted + skipped)) = 1018 ]
+[ "$(grep -c . random.epd)" = "$converted" ]
+[ "$(stat -c %s random.out.bin)" = $((converted * 40)) ]
+[ "$(grep -c "^Skipped $skipped records of random.bin" random.log)" = 3 ]
+
+rm -f random.bin corrupt.bin random.epd random.out.bin random.cmd random.log self.log
+rm -f packed.epd packed.txt packed.bin packed.out packed.cmd packed.log
+rm -f game.bin game.epd analysed.bin analysed.epd
+
+echo "packed testing OK"
@@ -0,0 +1,28 @@
+#!/bin/bash
+# verify the solve command on a few easy tactical positions
+
+error()
+{
+  echo "solve testing failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+echo "solve testing started"
+
+# the moves are in SAN, with captures, checks and castling
+cat << EOF > solve.epd
+2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - bm Qg6; id "WAC.001";
+5rk1/1ppb3p/p1pb4/6q1/3P1p1r/2P1R2P/PP1BQ1P1/5RKN w - - bm Rg3; id "WAC.003";
+r1bq2rk/pp3pbp/2p1p1pQ/7P/3P4/2PB1N2/PP3PPR/2KR4 w - - bm Qxh7+; id "WAC.004";
+5k2/6pp/p1qN4/1p1p4/3P4/2PKP2Q/PP3r2/3R4 b - - bm Qc4+; id "WAC.005";
+r3k2r/8/8/8/8/8/8/R3K2R w KQkq - bm Rxa8+ Rxh8+; am O-O O-O-O; id "castling";
+EOF
+
+printf "solve solve.epd depth 10\nquit\n" | ./stockfish 2>&1 | tee solve.log
+grep -q "Solved          : 5 (100.0%)" solve.log
+! grep -q "illegal move" solve.log
+
+rm -f solve.epd solve.log
+
+echo "solve testing OK"